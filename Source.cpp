@@ -1,1004 +1,6523 @@
-#include <iostream>
-#include <codecvt> ///req for windows to read unicode characters
-#include <chrono> ///used to log time taken to perform processes
-#include <thread> ///multithreading library
-#include <boost/filesystem.hpp> ///used to read windows file system
-#include <boost/functional/hash.hpp> ///used to hash incoming files
-
-///these files are used as well but are added by other libraries or by the compiler i'm using (VS 2015, C++ 14.0, along with boost 1.75_0 win32)
-//#include <fstream>
-//#include <iterator>
-//#include <string>
-//#include <locale>
-//#include <wstring>
-//#include <map>
-///-----------------------------------------------------------------------------------------------------------
-
-///struct used to store required file data
-struct media_data
-{
-	double fhash;
-	std::wstring fpath;
-};
-
-
-//menu functions------------------------------------------------------------
-///cleans console for menuing purposes
-void clear_console();
-//--------------------------------------------------------------------------
-
-
-//file scan functions-------------------------------------------------------
-///takes root directory wstring as input, scans for all wanted media files
-///returns a trimmed map containing only potential duplicate files into media_map
-void scan_directories(std::wstring &directorypath, int &counter, std::multimap<int, media_data> &media_map);
-
-///scan_directories helper function
-void find_duplicates(std::vector<int> &duplicate_keys, std::multimap<int, std::wstring> &media_map);
-
-///get hash value (partial) of selected file
-double get_hash(std::wstring filepath, int filesize);
-
-///scan_directories helper function
-void process_entries(std::vector<int> &keys_of_duplicates, std::multimap<int, std::wstring> &initial_read, std::multimap<int, media_data> &return_map);
-
-///separates trimmed multimap into an array of vectors to allow multithreading
-void split_map (std::vector<std::vector<std::pair<int, media_data>>> &media_vector_vector, std::multimap<int, media_data> &media_map_to_split);
-//--------------------------------------------------------------------------
-
-
-//deletion via subdirectory functions---------------------------------------
-///multithread manager function: deletes duplicate media files from selected subdirectory from entire directory
-void selected_duplicate_deletion(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::wstring &media_dir, int &counter);
-
-///reads the given directory and fills the given multimap with data from all valid files within
-void load_subdirectory(std::wstring &directory, std::multimap<int, media_data>& sub_map);
-
-///selected_duplicate_deletion helper function: spreads deletion work between multiple threads defined within selected_duplicate_deletion
-void remove_selected_duplicates_from_subvectors(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::vector<std::vector<std::pair<int, media_data>>> &sub_media_vector, std::vector<int> &indices, int &counter, char *buffer1, char *buffer2);
-
-//deletion of all duplicate media files in directory functions---------------
-///multithread manager function: deletes all duplicate media files from entire directory
-void full_duplicate_deletion(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, int &counter);
-
-///full_duplicate_deletion helper function: spreads deletion work between multiple threads defined within full_duplicate_deletion
-void remove_all_duplicates_from_subvectors(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::vector<int> &indices, int &counter, char *buffer1, char *buffer2);
-
-///remove_duplicates_from_subvectors helper function: scans given vector for given iterator, deletes if found
-void sync_vectors(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, int &index, std::vector<std::pair<int, media_data>>::iterator &mt);
-//--------------------------------------------------------------------------
-
-
-//shared functions----------------------------------------------------------
-///performs byte by byte comparison on given media_files to confirm they are identical
-///returns 1 if true, 0 if false, and -1 or -2 if a read error occurs on file1 or file2 respectively
-int match_media_files(std::ifstream &ifile1, std::ifstream &ifile2, char *buffer1, char *buffer2, int &filesize, std::wstring &file1, std::wstring &file2);
-
-///0s indexes in global media buffers after each use by threads for safety
-void clear_buffers(int &filesize, char *buffer1, char *buffer2);
-
-///used by get_hash to clear local buffer
-void clear_buffer(int &filesize, char *buffer1);
-//--------------------------------------------------------------------------
-
-
-//currently unused functions------------------------------------------------
-void debug();
-
-///reads db file into multimap
-void read_database(std::string const &db, std::multimap<int, media_data> &media_map);
-
-///writes multimap to bd file
-void write_map_to_db(std::string const &db, std::multimap<int, media_data> &media_map);
-//--------------------------------------------------------------------------
-
-
-//buffer_size may be increased to allow higher file sizes, but will use more RAM
-#define buffer_size 75000000 //75MB of char space (files with higher filesizes wouldn't be fully compared so are excluded)
-//note: filesize is stored in an integer, so the maximum buffer_size possible is 2147483647byes (2048MB or 2GB)
-
-//the number of bytes to compute during file hashing
-#define bytes_to_hash 30000 //.03MB of char space (larger numbers cause significant performance drops on file read and are unnecessary)
-
-//required to stop threads from running over each other when calling _wremove
-std::mutex deletion_mutex;
-
-//media buffers need to declared globally to avoid a potential stack overflow
-char buffer1[buffer_size] = { 0 }; //arrays are to 0 for safety
-char buffer2[buffer_size] = { 0 };
-char buffer3[buffer_size] = { 0 };
-char buffer4[buffer_size] = { 0 };
-char buffer5[buffer_size] = { 0 };
-char buffer6[buffer_size] = { 0 };
-char buffer7[buffer_size] = { 0 };
-char buffer8[buffer_size] = { 0 };
-
-int main()
-{
-	//std::string const db = "media.db"; //static database location, loaded on startup and saved on return (currently unused)
-	//std::wofstream ofile; //ofstream for db file
-	std::multimap<int, media_data> media_map; //multimap in the form <int, double, string>, <filesize, file hash, filepath>, with filesize being the key value
-	std::vector<std::vector<std::pair<int, media_data>>> media_vector; //contains multimap from above fractured by filesizes for thread safety
-	std::wstring media_dir; //user input media directories (root and sub)
-	int input = 0; //user menu input
-	int counter = 0; //counter for files scanned/deleted
-
-	//console control menu
-	while (true)
-	{
-		switch (input)
-		{
-		//main menu
-		case 0:
-		{
-			clear_console();
-
-			//prompt user
-			//std::cout << "Duplicate Media Remover.\n";
-			std::cout << "This program will remove duplicate files with a filesize less than " << buffer_size/1000000 << "MB\n";
-			std::cout << "(it is recommended to run 2 on all important folders before moving to 3)\n";
-			std::cout << "-----------------------------------------------------------------------\n\n";
-			std::cout << "1: choose root media file directory\n\n";
-			std::cout << "2: remove duplicates from subdirectory (used to preserve file structure)\n\n";
-			std::cout << "3: remove duplicates from entire directory (does not preserve file structure)\n\n";
-			std::cout << "4: exit program\n";
-			std::cout << "\n\nInput: ";
-			std::cin >> input;
-			break;
-		}
-
-		//read files to db
-		case 1:
-		{
-			//delete old db values if program is reloaded but new input is selected
-			//media_map.clear();
-
-			clear_console();
-
-			//prompt user
-			std::cout << "Scan Directory\nPlease input the filepath to the media files directory you would like to scan:\n";
-			std::cout << "for example, C:\\media\\vacation photos\n\n";
-			std::cout << "Input: ";
-
-			//mixing '>>' '<<' and getline, have to clean input
-			std::cin.clear();
-			std::cin.sync();
-			std::cin.ignore();
-
-			//read user input
-			std::getline(std::wcin, media_dir);
-
-			//log time taken to run functions
-			auto time1 = std::chrono::high_resolution_clock::now();
-
-			//read files from directory into media_map (only retains files that have potential duplicates)
-			scan_directories(media_dir, counter, media_map);
-
-			//split mmap into vector array
-			split_map(media_vector, media_map);
-
-			auto time2 = std::chrono::high_resolution_clock::now();
-
-			auto ms_taken = std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1);
-
-			std::cout << "\nScanned " << counter << " files in " << ms_taken.count() << "ms\n\n";
-			
-			//reset variables
-			counter = 0;
-			input = 0;
-			
-			//wait for user recognition
-			system("PAUSE");
-			break;
-		}
-
-		//delete media_files from entire directory with final copies ending in selected subdirectory
-		case 2:
-		{
-			clear_console();
-
-			//prompt user
-			std::cout << "Please select a subdirectory\n";
-			std::cout << "   The given directory will be scanned for all valid media files\n";
-			std::cout << "   Those files will then be compared against files in the root directory\n";
-			std::cout << "   Duplicate files will be removed\n";
-			std::cout << "   The remaining file will remain in the selected subdirectory\n\n";
-			std::cout << "Input: ";
-
-
-			//mixing '>>' '<<' and getline, have to clean input
-			std::cin.clear();
-			std::cin.sync();
-			std::cin.ignore();
-
-			//read user input
-			std::getline(std::wcin, media_dir);
-
-			//run function and log time
-			auto time1 = std::chrono::high_resolution_clock::now();
-
-			selected_duplicate_deletion(media_vector, media_dir, counter);
-
-			auto time2 = std::chrono::high_resolution_clock::now();
-
-			auto ms_taken = std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1);
-
-			std::cout << "\nAction completed. " << counter << " duplicate media files were removed in " << ms_taken.count() << "ms\n\n";
-
-			//reset variables
-			counter = 0;
-			input = 0;
-
-			//wait for user recognition
-			system("PAUSE");
-			break;
-		}
-
-		//delete all redundant media_files
-		case 3:
-		{
-			clear_console();
-
-			std::cout << "Full redundant media files scan.\n\n";
-
-			//run function and log times
-			auto time1 = std::chrono::high_resolution_clock::now();
-
-			full_duplicate_deletion(media_vector, counter);
-
-			auto time2 = std::chrono::high_resolution_clock::now();
-
-			auto ms_taken = std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1);
-
-			std::cout << "\nAction completed. " << counter << " duplicate media files were removed in " << ms_taken.count() << "ms\n\n\n";
-
-			//reset variables
-			counter = 0;
-			input = 0;
-
-			//wait for user recognition
-			system("PAUSE");
-			break;
-		}
-
-		//exit program
-		case 4:
-		{
-			//write db file on exit to allow speedier startup if user has to stop midway
-			//write_map_to_db(db, media_map);
-
-			return 0;
-		}
-
-		//ask again if non-menu item is chosen
-		default:
-			input = 0;
-		}
-	}
-}
-
-//menu functions------------------------------------------------------------
-void clear_console()
-{
-	std::cin.clear();
-	system("cls");
-}
-//--------------------------------------------------------------------------
-
-
-//file scan functions-------------------------------------------------------
-void scan_directories(std::wstring &directorypath, int &counter, std::multimap<int, media_data> &media_map)
-{
-	boost::filesystem::recursive_directory_iterator start(directorypath); //root directory
-	const boost::filesystem::recursive_directory_iterator end; //end of root directory (and all subdirectories)
-	std::multimap<int, std::wstring> initial_read; //temporary multimap for files
-	std::vector<int> keys_of_duplicates; //vector that stores any multimap entry with more than one matching key (repeat filesizes)
-
-	//recursively iterate all directories and scan for all wanted filetypes (doesn't check for filesize limitation)
-	for (; start != end; ++start)
-	{
-		counter++; //number of files read
-
-		//check if file is appropriate type (haven't tested with mp4, mp3, or other media formats yet, so they are excluded for now)
-		if (start->path().extension() == ".jpg" || start->path().extension() == ".jpeg" || start->path().extension() == ".png" || start->path().extension() == ".gif" || start->path().extension() == ".webm")
-		{
-			//check if the current file is small enough to fit inside the global buffers
-			if (boost::filesystem::file_size(start->path()) <= buffer_size)
-			{
-				//insert filesize and path into multimap if it is appropriate type
-				initial_read.insert({ boost::filesystem::file_size(start->path()), start->path().wstring() });
-			}
-		}
-	}
-
-	//read any values from initial_read with duplicate keys into a vector
-	find_duplicates(keys_of_duplicates, initial_read);
-
-	//trim off any excess files from temporary multimap, and then, sync it with main multimap (media_map)
-	process_entries(keys_of_duplicates, initial_read, media_map);
-
-	//local multimap is deleted on function return
-	//multimap containing potential duplicate files is sent back to main
-}
-
-void find_duplicates(std::vector<int> &duplicate_keys, std::multimap<int, std::wstring> &media_map)
-{
-	int prev_key = 0;
-	bool already_written = false;
-
-	//iterate multimap while push_backing all keys that contain more than one file into the vector
-	for (std::multimap<int, std::wstring>::iterator it = media_map.begin(); it != media_map.end(); it++)
-	{
-		//check if filesizes are the same and if the specific filesize has already been written into vector
-		if (prev_key == it->first && false == already_written)
-		{
-			//if so, push key value into vector
-			duplicate_keys.push_back(it->first);
-			already_written = true;
-		}
-		//elseif keys are different, reset check to find the next key value to insert
-		else if (prev_key != it->first) already_written = false; //array is sorted, so only have to check current and prev elements to check key space
-
-		prev_key = it->first;
-	}
-}
-
-double get_hash(std::wstring filepath, int filesize)
-{
-	static char local_buffer[bytes_to_hash] = { 0 }; //buffer for incoming media binary
-	static std::ifstream ifile;
-	static double hash_value;
-
-	//load file in binary mode
-	ifile.open(filepath, std::ifstream::binary | std::ifstream::in);
-
-	//return if read fails
-	if (ifile.fail())
-		return -1;
-
-	//load file into memory
-	std::memset(local_buffer, 0, bytes_to_hash);
-
-	ifile.read(local_buffer, bytes_to_hash);
-
-	//get hash
-	hash_value = boost::hash_value(local_buffer);
-	
-	//close file
-	ifile.close();
-
-	//clear buffer
-	clear_buffer(filesize, local_buffer);
-
-	//return hash value of file in buffer
-	return hash_value;
-}
-
-void process_entries(std::vector<int> &keys_of_duplicates, std::multimap<int, std::wstring> &initial_read, std::multimap<int, media_data> &return_map)
-{
-	media_data feeder; //feeds values to multimap
-	int filesize = 0;
-
-	for (int i = 0; i < keys_of_duplicates.size(); i++)
-	{
-		//puts range values of selected key into result
-		std::pair<std::multimap<int, std::wstring>::iterator, std::multimap<int, std::wstring>::iterator> result = initial_read.equal_range(keys_of_duplicates[i]);
-
-		//inner loop iterates the media_map only for the chosen key value from first to last entry
-		for (std::multimap<int, std::wstring>::iterator mt = result.first; mt != result.second; mt++)
-		{
-			filesize = mt->first;
-
-			//get hash value of file
-			feeder.fhash = get_hash(mt->second, filesize);
-
-			//get filepath
-			feeder.fpath = mt->second;
-
-			//emplace filesize as key and media_map (hash and filepath) as second value
-			return_map.emplace(mt->first, feeder);
-		}
-	}
-}
-
-void split_map(std::vector<std::vector<std::pair<int, media_data>>> &media_vector_vector, std::multimap<int, media_data> &media_map_to_split)
-{
-	//for each unique filesize (key) value in media_map, create a new vector to contain that keys entries
-
-	std::vector<std::pair<int, media_data>> carryover_vector;
-	int current_filesize = NULL;
-	double current_hash = NULL;
-	static int i = 0;
-
-	std::multimap<int, media_data>::iterator it = media_map_to_split.begin();
-
-	//load first value into vector
-	current_filesize = it->first;
-
-	current_hash = it->second.fhash;
-
-	carryover_vector.emplace_back(it->first, it->second);
-
-	for (it; it != media_map_to_split.end();)
-	{
-		it++;
-
-		//shortcut if end of mmap is reached
-		if (it == media_map_to_split.end())
-		{
-			media_vector_vector.push_back(carryover_vector);
-		}
-		//else, normal logic
-		else
-		{
-			//if key values match, place them into the same vector
-			if (current_filesize == it->first && current_hash == it->second.fhash)
-			{
-				carryover_vector.emplace_back(it->first, it->second);
-			}
-
-			//else, new key is found
-			//add completed vector to vector of vectors and start a new one
-			else
-			{
-				current_filesize = it->first;
-
-				current_hash = it->second.fhash;
-
-				media_vector_vector.push_back(carryover_vector);
-
-				carryover_vector.clear();
-
-				carryover_vector.emplace_back(it->first, it->second);
-			}
-		}
-	}
-}
-//--------------------------------------------------------------------------
-
-
-//deletion via subdirectory functions---------------------------------------
-void selected_duplicate_deletion(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::wstring &media_dir, int &counter)
-{
-	std::multimap<int, media_data> sub_map; //multimap for initial file read
-	std::vector<std::vector<std::pair<int, media_data>>> sub_vector; //vector of vectors to store fractured multimap for thread safety
-	std::thread thread1, thread2, thread3, thread4;
-	std::vector<int> thread1_queue, thread2_queue, thread3_queue, thread4_queue; //queues for each running thread
-	bool thread1_is_running = false, thread2_is_running = false, thread3_is_running = false, thread4_is_running = false;
-	int temp_counter1 = 0, temp_counter2 = 0, temp_counter3 = 0, temp_counter4 = 0; //counters to sum after threads run
-	int switcher = 1; //switch channel
-
-
-	load_subdirectory(media_dir, sub_map);
-
-	split_map(sub_vector, sub_map);
-
-	for (int i = 0; i < sub_vector.size(); i++)
-	{
-		switch (switcher)
-		{
-		case 1:
-		{
-			thread1_queue.push_back(i);
-			switcher++;
-			break;
-		}
-		case 2:
-		{
-			thread2_queue.push_back(i);
-			switcher++;
-			break;
-		}
-		case 3:
-		{
-			thread3_queue.push_back(i);
-			switcher++;
-			break;
-		}
-		case 4:
-		{
-			thread4_queue.push_back(i);
-			switcher = 1;
-			break;
-		}
-		}
-	}
-
-	//run multithreading (if thread queue isn't empty)
-	if (0 < thread1_queue.size())
-	{
-		thread1_is_running = true;
-		thread1 = std::thread(remove_selected_duplicates_from_subvectors, std::ref(media_vector), std::ref(sub_vector), std::ref(thread1_queue), std::ref(temp_counter1), buffer1, buffer2);
-	}
-
-	if (0 < thread2_queue.size())
-	{
-		thread2_is_running = true;
-		thread2 = std::thread(remove_selected_duplicates_from_subvectors, std::ref(media_vector), std::ref(sub_vector), std::ref(thread2_queue), std::ref(temp_counter2), buffer3, buffer4);
-	}
-
-	if (0 < thread3_queue.size())
-	{
-		thread3_is_running = true;
-		thread3 = std::thread(remove_selected_duplicates_from_subvectors, std::ref(media_vector), std::ref(sub_vector), std::ref(thread3_queue), std::ref(temp_counter3), buffer5, buffer6);
-	}
-
-	if (0 < thread4_queue.size())
-	{
-		thread4_is_running = true;
-		thread4 = std::thread(remove_selected_duplicates_from_subvectors, std::ref(media_vector), std::ref(sub_vector), std::ref(thread4_queue), std::ref(temp_counter4), buffer7, buffer8);
-	}
-
-	//join threads (if ran)
-	if (thread1_is_running)
-	{
-		thread1.join();
-		counter += temp_counter1;
-	}
-
-	if (thread2_is_running)
-	{
-		thread2.join();
-		counter += temp_counter2;
-	}
-
-	if (thread3_is_running)
-	{
-		thread3.join();
-		counter += temp_counter3;
-	}
-
-	if (thread4_is_running)
-	{
-		thread4.join();
-		counter += temp_counter4;
-	}
-}
-
-void load_subdirectory(std::wstring &directory, std::multimap<int, media_data>& sub_map)
-{
-	media_data feeder; //feeds data to multimap
-	boost::filesystem::recursive_directory_iterator start(directory); //start of directory
-	const boost::filesystem::recursive_directory_iterator end; //end of directory
-	int filesize;
-															   //scan subdirectory (and its subdirectories) into the sub_map if filetypes match
-	for (; start != end; ++start)
-	{
-		if (start->path().extension() == ".jpg" || start->path().extension() == ".jpeg" || start->path().extension() == ".png" || start->path().extension() == ".gif" || start->path().extension() == ".webm")
-		{
-			filesize = boost::filesystem::file_size(start->path());
-			if (filesize <= buffer_size)
-			{
-				feeder.fhash = get_hash(start->path().wstring(), filesize);
-
-				feeder.fpath = start->path().wstring();
-
-				sub_map.emplace(boost::filesystem::file_size(start->path()), feeder);
-			}
-		}
-	}
-}
-
-void remove_selected_duplicates_from_subvectors(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::vector<std::vector<std::pair<int, media_data>>> &sub_media_vector, std::vector<int> &indices, int &counter, char *buffer1, char *buffer2)
-{
-	std::ifstream ifile1, ifile2; //ifstream for files to scan against each other
-	int media_case = 0; //return value for match_media_files (-1 and -2 are read errors, 0 is no match, 1 is match)
-
-	//iterate through indices given to the running thread
-	for (int i = 0; i < indices.size(); i++)
-	{
-		for (auto it = sub_media_vector[indices[i]].begin(); it != sub_media_vector[indices[i]].end(); it++)
-		{
-			//scan for appropriate filesize in media_vector
-			for (int j = 0; j < media_vector.size(); j++)
-			{
-				for (auto nit = media_vector[j].begin(); nit != media_vector[j].end(); nit++)
-				{
-					//when correct index is found
-					if (it->first == nit->first)
-					{
-						for (nit; nit != media_vector[j].end();)
-						{
-							//check if current 'it' is the selected 'nit'
-							if (it->second.fpath != nit->second.fpath)
-							{
-								//if duplicate images are found, remove second element found (earliest vector entries are preserved)
-								media_case = match_media_files(ifile1, ifile2, buffer1, buffer2, it->first, it->second.fpath, nit->second.fpath);
-
-								//if media_files match
-								if (1 == media_case)
-								{
-									//reset media_case
-									media_case = 0;
-
-									//delete offending media from file system (mutex required to not potentially overload system calls)
-									deletion_mutex.lock();
-
-									_wremove(nit->second.fpath.c_str());
-
-									deletion_mutex.unlock();
-
-									//check if entry needs to be erased from it vector
-									//sync_vectors(sub_media_vector, i, nit);
-
-									//erase entry from nit vector
-									nit = media_vector[j].erase(nit);
-
-									//increase media files deleted counter
-									counter++;
-								}
-								else
-								{
-									nit++;
-								}
-							}
-							else nit++;
-
-							//may hit end of iteration early due to deletion in media_vector, so check is required
-							if (media_vector[j].end() == nit)
-								break;
-						}
-					}
-					if (media_vector[j].end() == nit)
-						break;
-				}
-			}
-		}
-	}
-}
-
-void sync_vectors(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, int &index, std::vector<std::pair<int, media_data>>::iterator &mt)
-{
-	for (auto it = media_vector[index].begin(); it != media_vector[index].end(); it++)
-	{
-		if (it->second.fpath == mt->second.fpath)
-		{
-			//if deleted element is found in media_vector, remove it
-			media_vector[index].erase(it);
-			break;
-		}
-	}
-}
-//--------------------------------------------------------------------------
-
-
-//deletion of all duplicate media files in directory functions---------------
-void full_duplicate_deletion(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, int &counter)
-{
-	std::thread thread1, thread2, thread3, thread4;
-	std::vector<int> thread1_queue, thread2_queue, thread3_queue, thread4_queue;
-	bool thread1_is_running = false, thread2_is_running = false, thread3_is_running = false, thread4_is_running = false;
-	int temp_counter1 = 0, temp_counter2 = 0, temp_counter3 = 0, temp_counter4 = 0;
-	int switcher = 1;
-
-	//split vector<vector> indices into three queues
-	for (int i = 0; i < media_vector.size(); i++)
-	{
-		switch (switcher)
-		{
-		case 1:
-		{
-			thread1_queue.push_back(i);
-			switcher++;
-			break;
-		}
-		case 2:
-		{
-			thread2_queue.push_back(i);
-			switcher++;
-			break;
-		}
-		case 3:
-		{
-			thread3_queue.push_back(i);
-			switcher++;
-			break;
-		}
-		case 4:
-		{
-			thread4_queue.push_back(i);
-			switcher = 1;
-			break;
-		}
-		}
-	}
-
-	//run multithreading if thread queue isn't empty
-	if (0 < thread1_queue.size())
-	{
-		thread1_is_running = true;
-		thread1 = std::thread(remove_all_duplicates_from_subvectors, std::ref(media_vector), std::ref(thread1_queue), std::ref(temp_counter1), buffer1, buffer2);
-	}
-	
-	if (0 < thread2_queue.size())
-	{
-		thread2_is_running = true;
-		thread2 = std::thread(remove_all_duplicates_from_subvectors, std::ref(media_vector), std::ref(thread2_queue), std::ref(temp_counter2), buffer3, buffer4);
-	}
-	
-	if (0 < thread3_queue.size())
-	{
-		thread3_is_running = true;
-		thread3 = std::thread(remove_all_duplicates_from_subvectors, std::ref(media_vector), std::ref(thread3_queue), std::ref(temp_counter3), buffer5, buffer6);
-	}
-
-	if (0 < thread4_queue.size())
-	{
-		thread4_is_running = true;
-		thread4 = std::thread(remove_all_duplicates_from_subvectors, std::ref(media_vector), std::ref(thread4_queue), std::ref(temp_counter4), buffer7, buffer8);
-	}
-
-	//join threads (if ran)
-	if (thread1_is_running)
-	{
-		thread1.join();
-		counter += temp_counter1;
-	}
-
-	if (thread2_is_running)
-	{
-		thread2.join();
-		counter += temp_counter2;
-	}
-
-	if (thread3_is_running)
-	{
-		thread3.join();
-		counter += temp_counter3;
-	}
-
-	if (thread4_is_running)
-	{
-		thread4.join();
-		counter += temp_counter4;
-	}
-}
-
-void remove_all_duplicates_from_subvectors(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::vector<int> &indices, int &counter, char *buffer1, char *buffer2)
-{
-	std::ifstream ifile1, ifile2;
-	int media_case = 0; //return value for match_media_files (-1 is error, 0 is no match, 1 is match)
-
-	//iterate through indices given to the running thread
-	for (int i = 0; i < indices.size(); i++)
-	{
-		//iterate the appropiate subvector given by the current index
-		for (auto it = media_vector[indices[i]].begin(); it != media_vector[indices[i]].end(); it++) //likely to cause a crash from ++it's location
-		{
-			//iterate all following elements, comparing against original
-			for (auto nit = std::next(it); nit != media_vector[indices[i]].end();)
-			{
-				//if duplicate images are found, remove second element found (earliest vector entries are preserved)
-				media_case = match_media_files(ifile1, ifile2, buffer1, buffer2, it->first, it->second.fpath, nit->second.fpath);
-
-				//if media_files match
-				if (1 == media_case)
-				{
-					//reset media_case
-					media_case = 0;
-
-					//delete offending media from file system (mutex required not to potentially overload system calls)
-					deletion_mutex.lock();
-
-					_wremove(nit->second.fpath.c_str());
-
-					deletion_mutex.unlock();
-
-					//erase entry from vector
-					nit = media_vector[indices[i]].erase(nit);
-
-					//increase media files deleted counter
-					counter++;
-				}
-				else
-				{
-					nit++;
-				}
-			}
-			//may hit end of iteration early due to deletion in media_vector, so check is required
-			if (media_vector[indices[i]].end() == it) 
-				break;
-		}
-	}
-}
-//--------------------------------------------------------------------------
-
-
-//shared functions----------------------------------------------------------
-int match_media_files(std::ifstream &ifile1, std::ifstream &ifile2, char *buffer1, char *buffer2, int &filesize, std::wstring &file1, std::wstring &file2)
-{
-	//read media1 into a char buffer
-	ifile1.open(file1, std::ifstream::binary | std::ifstream::in);
-
-
-	//check if media1 opened successfully or return error if it didn't
-	if (ifile1.fail())
-	{
-		clear_buffers(filesize, buffer1, buffer2);
-		return -1; //if file2 fails to read, return -1
-	}
-
-	//load media1 into buffer
-	std::memset(buffer1, 0, buffer_size);
-	ifile1.read(buffer1, buffer_size);
-	
-	//close ifstream for media1
-	ifile1.close();
-
-	//read media2 into a char buffer
-	ifile2.open(file2, std::ifstream::binary | std::ifstream::in);
-
-	//check if media2 opened successfully or return error if it didn't
-	if (ifile2.fail())
-	{
-		clear_buffers(filesize, buffer1, buffer2);
-		return -2; //if file2 fails to read, return -2
-	}
-
-	//load media2 into buffer
-	std::memset(buffer2, 0, buffer_size);
-	ifile2.read(buffer2, buffer_size);
-	
-	//close ifstream for media2
-	ifile2.close();
-
-	//compare buffers byte by byte
-	for (int i = 0; i < filesize; i++)
-	{
-		//if buffers differ
-		if (buffer1[i] != buffer2[i])
-		{
-			//clear used portion of buffers
-			clear_buffers(filesize, buffer1, buffer2);
-			return 0; //return false for match
-		}
-	}
-
-	//only reached if buffers are identical
-	//reset buffers
-	clear_buffers(filesize, buffer1, buffer2);
-	return 1; //return true for match
-}
-
-void clear_buffers(int &filesize, char *buffer1, char *buffer2)
-{
-	//reset selected buffer indices to 0
-	for (int i = 0; i < filesize; i++)
-	{
-		buffer1[i] = 0;
-		buffer2[i] = 0;
-	}
-}
-
-void clear_buffer(int &filesize, char *buffer1)
-{
-	//reset selected buffer indices to 0
-	for (int i = 0; i < filesize; i++)
-	{
-		buffer1[i] = 0;
-	}
-}
-//--------------------------------------------------------------------------
-
-
-//currently unused functions------------------------------------------------
-void debug()
-{
-	/*int _switch = 1;
-	std::wstring fpath = L"G:\\projects\\test images";
-	std::wstring subfolder = L"G:\\projects\\test images\\sub folder";
-
-	scan_directories(fpath, counter, media_map);
-
-	//split mmap into vector array
-	split_map(media_vector, media_map);
-
-	counter = 0;
-
-	//std::vector<int> test_vec;
-	//test_vec.push_back(0);
-	//test_vec.push_back(1);
-	//test_vec.push_back(2);
-	//test_vec.push_back(3);
-
-	//log time taken to run function
-	auto time1 = std::chrono::high_resolution_clock::now();
-
-	selected_duplicate_deletion(media_vector, subfolder, counter);
-	//read files from directory into media_map (only retains files that have potential duplicates)
-	//full_duplicate_deletion(media_vector, counter);
-
-	auto time2 = std::chrono::high_resolution_clock::now();
-
-	auto ms_taken1 = std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1);
-
-	std::cout << "\nRemoved " << counter << " files in " << ms_taken1.count() << "ms\n\n";
-
-	//log time taken to run function
-	auto time3 = std::chrono::high_resolution_clock::now();
-
-	//selected_duplicate_deletion(media_vector, subfolder, counter);
-	//read files from directory into media_map (only retains files that have potential duplicates)
-	full_duplicate_deletion(media_vector, counter);
-
-	auto time4 = std::chrono::high_resolution_clock::now();
-
-	auto ms_taken2 = std::chrono::duration_cast<std::chrono::milliseconds>(time4 - time3);
-
-	std::cout << "\nRemoved " << counter << " files in " << ms_taken2.count() << "ms\n\n";
-
-	//final_cleanup(ifile1, ifile2, separated_filesizes, counter);*/
-}
-
-void read_database(std::string const &db, std::multimap<int, media_data> &media_map)
-{
-	std::wifstream ifile;
-	std::wstring line;
-	media_data feeder;
-	int filesize, count = 0;
-	double hash;
-
-	ifile.open(db);
-
-	std::getline(ifile, line); //throw away first line (indexers)
-
-	while (std::getline(ifile, line))
-	{
-		if (0 == count) //get filesize
-		{
-			filesize = std::stoi(line);
-			count++;
-		}
-
-		else if (1 == count) //get hash
-		{
-			hash = std::stod(line);
-			count++;
-		}
-
-		else if (2 == count) //get filepath
-		{
-			feeder.fhash = hash;
-			feeder.fpath = line;
-			media_map.emplace(filesize, feeder);
-			count = 0;
-		}
-
-	}
-
-	ifile.close();
-}
-
-void write_map_to_db(std::string const &db, std::multimap<int, media_data> &media_map)
-{
-	std::locale loc(std::locale::classic(), new std::codecvt_utf8<wchar_t>); // to imbue wofstream with unicode chars
-	std::wofstream database;
-
-	database.imbue(loc);
-
-	//open db
-	database.open(db);
-
-	//check for write permission
-	if (database.fail())
-		return;
-
-	//prevent hash from being written in sci notation
-	database.setf(std::ios_base::fixed);
-
-	//output first line
-	database << "filesize, file hash, filepath\n";
-
-	//output map data for each element
-	for (std::multimap<int, media_data>::iterator it = media_map.begin(); it != media_map.end(); ++it)
-	{
-		//map_reader = it->second;
-		database << it->first << std::endl;
-		database << it->second.fhash << std::endl;
-		database << it->second.fpath << std::endl;
-	}
-
-	//close file
-	database.close();
-}
+#include <iostream>
+#include <codecvt> ///req for windows to read unicode characters
+#include <chrono> ///used to log time taken to perform processes
+#include <thread> ///multithreading library
+#include <atomic> ///lock-free counters for run metrics
+#include <mutex> ///deletion and progress synchronization
+#include <condition_variable> ///wakes the progress reporter on shutdown
+#include <functional> ///filesystem walk callbacks
+#include <memory> ///filesystem backend file handles
+#include <deque> ///pipeline queues
+#include <unordered_map> ///pipeline size buckets
+#include <unordered_set>
+#include <limits> ///console input clearing
+#include <random> ///synthetic corpus generation for benchmarks
+#include <iomanip> ///benchmark table formatting
+#include <algorithm> ///grouping sort
+#include <array> ///small file digests
+#include <map> ///chunk overlap pairs
+#include <boost/filesystem.hpp> ///used to read windows file system
+#include <boost/filesystem/fstream.hpp> ///wide path file streams for benchmark corpora
+#include <boost/functional/hash.hpp> ///used to hash incoming files
+#include <boost/align/aligned_alloc.hpp> ///page aligned read buffers
+#ifndef _WIN32
+#include <fcntl.h> ///POSIX filesystem backend
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h> ///daemon query socket
+#include <sys/un.h>
+#include <poll.h>
+#include <csignal>
+#ifdef __linux__
+#include <sys/ioctl.h> ///shared extents for the chunk overlap analysis
+#include <linux/fs.h>
+#endif
+#endif
+
+///these files are used as well but are added by other libraries or by the compiler i'm using (VS 2015, C++ 14.0, along with boost 1.75_0 win32)
+//#include <fstream>
+//#include <iterator>
+//#include <string>
+//#include <locale>
+//#include <wstring>
+//#include <map>
+///-----------------------------------------------------------------------------------------------------------
+
+///struct used to store required file data
+struct media_data
+{
+	double fhash;
+	std::wstring fpath;
+	int digest_id; //nonzero for small files read whole, equal ids mean equal SHA-256 digests (see small_digest_ids)
+	int distinct_set; //group members sharing a nonzero set were proven different from each other by an earlier run
+};
+
+//histograms are bucketed by powers of two, 40 buckets covers values up to ~1 trillion (microseconds or files)
+#define histogram_buckets 40
+
+//deletion threads report busy time into fixed slots, which also caps --threads
+#define max_tracked_threads 64
+
+//the JSON summary of the last run is written here (overwritten every run)
+#define summary_file "media_summary.json"
+
+//stages a run moves through, used by the progress line and the summary
+enum run_stage { stage_idle, stage_walk, stage_hash, stage_group, stage_compare, stage_pipeline, stage_ingest, stage_subtree, stage_chunk };
+const char *stage_names[] = { "idle", "walk", "hash", "group", "compare", "pipeline", "ingest", "subtree", "chunk" };
+
+///lock-free power of two histogram, safe to record into from any thread
+struct log2_histogram
+{
+	std::atomic<long long> buckets[histogram_buckets];
+	std::atomic<long long> count;
+	std::atomic<long long> sum;
+};
+
+///counters for a single run, reset by reset_metrics before every menu option
+struct run_metrics
+{
+	std::chrono::steady_clock::time_point start_time;
+
+	std::atomic<int> stage;
+	std::atomic<long long> stage_done; //units of work finished in the current stage
+	std::atomic<long long> stage_total; //units of work in the current stage (0 if unknown)
+
+	std::atomic<long long> files_walked; //every directory entry visited
+	std::atomic<long long> files_candidate; //media files sharing a filesize with another file
+	std::atomic<long long> files_hashed;
+	std::atomic<long long> files_small; //hashed whole by the small file tier (also counted in files_hashed)
+	std::atomic<long long> files_removed;
+	std::atomic<long long> comparisons;
+
+	std::atomic<long long> skipped_extension; //not a supported media type
+	std::atomic<long long> skipped_too_large; //larger than max_file_size
+	std::atomic<long long> skipped_unique_size; //no other file has the same filesize
+	std::atomic<long long> skipped_read_error; //failed to open during hashing or comparison
+
+	std::atomic<long long> bytes_hashed; //bytes read by get_hash
+	std::atomic<long long> bytes_compared; //bytes read by match_media_files
+
+	std::atomic<long long> pool_peak_bytes; //most read buffer memory leased at once
+	std::atomic<long long> pool_wait_us; //total time threads waited for the memory budget
+
+	std::atomic<long long> filter_hits; //incoming files the ingest Bloom filter could not rule out
+	std::atomic<long long> filter_false_positives; //filter hits no library file matched
+
+	std::atomic<long long> subtrees_collapsed; //directories found identical to an earlier walked directory
+	std::atomic<long long> files_collapsed; //media files below those directories, never grouped or compared one by one
+
+	std::atomic<long long> bytes_chunked; //bytes read by the chunk overlap analysis
+	std::atomic<long long> chunks_total;
+	std::atomic<long long> chunks_shared; //chunks also found in an earlier file
+	std::atomic<long long> bytes_shared; //bytes of those chunks
+	std::atomic<long long> bytes_extents_shared; //bytes the filesystem now stores once
+
+	std::atomic<long long> pairs_known_distinct; //comparisons skipped because the distinct cache already proved the pair different
+	std::atomic<long long> groups_known_distinct; //groups whose every comparison was skipped that way
+
+	log2_histogram group_size; //files per (filesize, hash) group
+	log2_histogram hash_latency_us; //per-file get_hash time
+	log2_histogram compare_latency_us; //per-pair match_media_files time
+
+	std::atomic<long long> thread_busy_us[max_tracked_threads]; //time each deletion thread spent running
+	std::atomic<long long> thread_wait_us[max_tracked_threads]; //time each deletion thread spent waiting on deletion_mutex
+	std::atomic<long long> thread_groups[max_tracked_threads]; //groups handled by each deletion thread
+	std::atomic<int> threads_used;
+};
+
+//every thread records its most recent trace_ring_size spans, older spans are overwritten
+#define trace_ring_size 65536
+
+//the timeline trace is written here when requested from the menu
+#define trace_file "media_trace.json"
+
+///a single completed span, name must be a string literal
+struct trace_event
+{
+	const char *name;
+	long long start_us; //relative to trace_epoch
+	long long duration_us;
+};
+
+///per-thread ring buffer of trace_events, only the owning thread writes to it
+struct trace_ring
+{
+	std::vector<trace_event> events;
+	std::atomic<long long> written; //total events ever recorded, next slot is written % trace_ring_size
+	int thread_id; //tid shown in the trace viewer
+	std::string thread_name;
+	bool in_use; //false once the owning thread exits, so the next new thread can reuse the ring
+};
+
+///records the time between construction and destruction as a span on the calling thread's ring
+struct trace_span
+{
+	const char *name;
+	std::chrono::steady_clock::time_point start;
+
+	trace_span(const char *span_name);
+	~trace_span();
+};
+
+///thread_local holder that hands a thread's trace ring back when the thread exits
+struct trace_ring_owner
+{
+	trace_ring *ring = nullptr;
+
+	~trace_ring_owner();
+};
+
+///settings for a synthetic media corpus, every file is derived from seed so corpora are reproducible
+struct corpus_config
+{
+	int file_count = 2000;
+	int min_size = 1000;
+	int max_size = 4000000;
+	bool log_sizes = true; //log-uniform sizes (mostly small files) instead of uniform
+	double duplicate_ratio = 0.2; //fraction of files that are exact copies of an earlier file
+	double collision_ratio = 0.05; //fraction of files sharing filesize and hashed header with an earlier file but differing after it
+	int directory_depth = 3;
+	int directory_fanout = 4; //subdirectories per directory
+	unsigned int seed = 1;
+};
+
+///fixed capacity queue between pipeline stages, push blocks while full (backpressure) and pop blocks while empty
+template <typename T>
+class bounded_queue
+{
+public:
+	explicit bounded_queue(size_t queue_capacity) : capacity(queue_capacity), closed(false) {}
+
+	///waits for space, returns false if the queue was closed
+	bool push(T item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		not_full.wait(lock, [this]() { return items.size() < capacity || closed; });
+
+		if (closed)
+			return false;
+
+		items.push_back(std::move(item));
+		not_empty.notify_one();
+
+		return true;
+	}
+
+	///waits for an item, returns false once the queue is closed and drained
+	bool pop(T &item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		not_empty.wait(lock, [this]() { return !items.empty() || closed; });
+
+		if (items.empty())
+			return false;
+
+		item = std::move(items.front());
+		items.pop_front();
+		not_full.notify_one();
+
+		return true;
+	}
+
+	///no more items will be pushed, wakes every waiting thread
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		closed = true;
+		not_full.notify_all();
+		not_empty.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable not_full, not_empty;
+	std::deque<T> items;
+	size_t capacity;
+	bool closed;
+};
+
+///hands out aligned, reusable read buffers of one chunk size while keeping the total leased to hashing and comparison inside a memory budget
+class buffer_pool
+{
+public:
+	///sets the budget and derives the chunk size from it and the number of threads that will read at once
+	void configure(long long budget_bytes, int threads);
+
+	///leases count chunk sized buffers at once, waiting while they would exceed the budget
+	void acquire(int count, char **buffers);
+
+	///returns buffers leased by acquire
+	void release(int count, char **buffers);
+
+	long long chunk_size();
+	long long budget_size();
+
+private:
+	std::mutex mutex;
+	std::condition_variable available;
+	std::vector<char*> free_buffers;
+	long long budget = 0;
+	long long chunk_bytes = 0;
+	long long in_use = 0; //buffers currently leased
+	long long allocated = 0; //buffers allocated since the last configure
+};
+
+///RAII lease of up to two buffers from read_pool
+struct pooled_buffers
+{
+	char *data[2];
+	int count;
+
+	explicit pooled_buffers(int buffer_count);
+	~pooled_buffers();
+};
+
+///incremental SHA-256, used where a match must be proven from a digest alone
+class sha256_state
+{
+public:
+	sha256_state();
+
+	void update(char const *data, size_t length);
+
+	///writes the digest, the state can't be updated afterwards
+	void finish(unsigned char digest[32]);
+
+private:
+	void compress(unsigned char const *data);
+
+	unsigned int state[8];
+	unsigned char block[64]; //buffered partial block
+	size_t block_length;
+	unsigned long long total_length;
+};
+
+///compact sort key for grouping, record indexes the list the key was built from
+struct group_key
+{
+	double fhash; //0 while grouping by filesize alone
+	int filesize;
+	int record;
+};
+
+//first bytes of every shard file, the trailing digit is the format version
+#define shard_magic "MMSHARD1"
+
+//merge partitions shard records by the first byte of their digest
+#define merge_partitions 256
+
+///one file of an exported index shard
+struct shard_record
+{
+	long long filesize;
+	std::array<unsigned char, 32> digest; //SHA-256 of the whole file
+	std::string path; //UTF-8, relative to the exporting host's root, '/' separated
+	int host; //index of the shard (and host) the record came from
+};
+
+//directories need at least this many media files below them before an identical copy is collapsed as one unit
+#define subtree_min_files 2
+
+///a walked directory, hashed bottom up so that identical subtrees can be found
+struct directory_node
+{
+	std::wstring path;
+	int parent; //-1 for the scanned root
+	int height; //0 for a directory without subdirectories, identical subtrees always have the same height
+	int first_record; //earliest walked file below, decides which of a group of identical subtrees is kept
+	long long file_count; //media files below
+	std::vector<int> files; //initial_read records directly inside
+	std::vector<int> children;
+	size_t shape; //hash of the names and sizes of everything below, cheap to build from the walk alone
+	std::array<unsigned char, 32> digest; //SHA-256 of the names, sizes and contents of everything below
+	bool candidate; //this or a parent directory shares its shape with another directory
+	bool hashed; //every file below was read in full for the digest
+	bool covered; //inside a collapsed copy
+};
+
+///a subtree found identical to an earlier walked one, each of its files has a byte identical twin at the same relative path below kept
+struct subtree_copy
+{
+	std::wstring path;
+	std::wstring kept;
+	std::vector<std::wstring> files;
+};
+
+//content-defined chunk sizes for the overlap analysis, cut points are normalized around the average (FastCDC)
+#define cdc_min_chunk 16384
+#define cdc_avg_chunk 65536
+#define cdc_max_chunk 262144
+
+//smaller files can only be whole duplicates, the overlap analysis skips them
+#define cdc_min_file_size 1048576
+
+//the chunk index is split into this many partitions by the top byte of each fingerprint
+#define chunk_index_shards 256
+
+//filesystems only share whole blocks, so shared extents are trimmed to this alignment
+#define extent_block_size 4096
+
+//most bytes handed to the filesystem in one extent sharing request
+#define extent_request_size 16777216
+
+///one content-defined chunk of a file
+struct chunk_entry
+{
+	unsigned long long fingerprint;
+	int file; //index into the analysed files, in walk order
+	int length;
+	long long offset;
+};
+
+///a range of a file holding the same bytes as a range of an earlier file
+struct shared_extent
+{
+	long long offset;
+	long long source_offset;
+	long long length;
+};
+
+///chunks a file shares with one earlier file
+struct file_overlap
+{
+	long long bytes;
+	std::vector<shared_extent> extents; //only collected when the extents are to be shared
+};
+
+//first bytes of the distinct cache file, the trailing digit is the format version
+#define distinct_cache_magic "MMDIST01"
+
+///a file the distinct cache knows, keyed by path_id, only trusted while its size and modification time are unchanged
+struct distinct_record
+{
+	long long filesize;
+	long long modified; //in the backend's units, -1 if it can't tell (such files are never cached)
+	int set; //files sharing a set were proven different from each other, 0 for none
+};
+
+///64 bit fingerprint of one chunk, fed in pieces since a chunk may straddle two read buffers
+class chunk_fingerprint
+{
+public:
+	chunk_fingerprint();
+
+	void update(char const *data, size_t length);
+
+	///returns the fingerprint of everything fed since the last finish and starts over
+	unsigned long long finish();
+
+private:
+	void mix(unsigned long long word);
+
+	unsigned long long hash;
+	unsigned long long pending; //bytes of a word not yet mixed in
+	int pending_length;
+	long long total_length;
+};
+
+///a file moving through the pipelined engine
+struct pipeline_file
+{
+	long long sequence; //walk order, the earliest walked copy of a file is the one kept
+	int filesize;
+	double fhash;
+	std::wstring fpath;
+};
+
+///a verified duplicate handed to the action stage
+struct pipeline_action
+{
+	std::wstring duplicate; //file to remove
+	std::wstring original; //identical file that is kept
+};
+
+//the daemon index is split by filesize into this many shards, each published as a whole new version when it changes
+#define daemon_shard_count 256
+
+//daemon requests naming longer paths are rejected
+#define daemon_max_path 65536
+
+///request opcodes of the daemon protocol
+enum daemon_op { daemon_lookup = 'L', daemon_ingest = 'I', daemon_delete = 'D' };
+
+///response statuses of the daemon protocol
+enum daemon_status { daemon_unique, daemon_duplicate, daemon_indexed, daemon_removed, daemon_not_indexed, daemon_skipped, daemon_bad_request };
+
+///a library file held by the daemon, fhash is only computed once another file shares its size
+struct daemon_entry
+{
+	double fhash;
+	bool hashed;
+	std::wstring fpath;
+};
+
+///library files of one size
+typedef std::vector<daemon_entry> daemon_bucket;
+
+///filesize -> library files of that size, a published shard and its buckets are never modified so readers can use them without locking
+///a writer copies the bucket pointers and replaces only the bucket it changes
+typedef std::unordered_map<int, std::shared_ptr<const daemon_bucket>> daemon_shard;
+
+///size/hash index served by the daemon, readers take the current version of a shard while writers copy, edit and republish it
+class daemon_index
+{
+public:
+	daemon_index();
+
+	///current version of the shard holding filesize
+	std::shared_ptr<const daemon_shard> snapshot(int filesize);
+
+	///serializes writers of the shard holding filesize (readers never take it)
+	std::mutex &writer_lock(int filesize);
+
+	///replaces the shard holding filesize, the caller must hold its writer_lock
+	void publish(int filesize, std::shared_ptr<const daemon_shard> shard);
+
+	///size path was indexed with, -1 if it isn't indexed
+	int indexed_size(std::wstring const &path);
+
+	///records that path is indexed with filesize
+	void remember_path(std::wstring const &path, int filesize);
+
+	///forgets path, unless it has been indexed again with another size since
+	void forget_path(std::wstring const &path, int filesize);
+
+private:
+	std::shared_ptr<const daemon_shard> shards[daemon_shard_count];
+	std::mutex writer_mutexes[daemon_shard_count];
+
+	//path -> indexed size, so a delete finds its shard after the file is gone
+	std::unordered_map<std::wstring, int> path_sizes;
+	std::mutex path_mutex;
+};
+
+//first line of an ingest --index file, records follow as filesize, hash, modification time and path lines
+#define library_index_header L"filesize, file hash, modified time, filepath"
+
+///a library file as recorded in the ingest --index file, reused while the file keeps its size and modification time
+struct indexed_file
+{
+	int filesize;
+	double fhash;
+	long long modified; //in the backend's units, -1 if it couldn't tell (such files are hashed again every run)
+};
+
+//bits per library file in the ingest Bloom filter, with bloom_probes probes this gives about a 1% false positive rate
+#define bloom_bits_per_key 10
+#define bloom_probes 7
+
+///Bloom filter over the (filesize, sample hash) keys of a library, a miss proves no library file can match
+class bloom_filter
+{
+public:
+	explicit bloom_filter(size_t key_count);
+
+	void insert(int filesize, double fhash);
+
+	///false means no inserted key is equal, true means one may be
+	bool may_contain(int filesize, double fhash);
+
+private:
+	///two independent hashes of a key, probe i tests bit (first + i * second) % bit_count
+	static void key_hashes(int filesize, double fhash, unsigned long long &first, unsigned long long &second);
+
+	std::vector<unsigned long long> bits;
+	unsigned long long bit_count;
+};
+
+///an open file handed out by a media_filesystem, closed when destroyed
+class media_file
+{
+public:
+	virtual ~media_file() {}
+
+	///reads up to length bytes from the current position, returns the number of bytes read (0 at end of file)
+	virtual long long read(char *buffer, long long length) = 0;
+};
+
+///filesystem access used by the walker, hasher, comparator and deleter, so they can run against real or synthetic files
+class media_filesystem
+{
+public:
+	virtual ~media_filesystem() {}
+
+	///calls visit with the path of every regular file below root (recursively)
+	virtual void walk(std::wstring const &root, std::function<void(std::wstring const &)> const &visit) = 0;
+
+	///returns the size of the file in bytes, or -1 if it can't be read
+	virtual long long file_size(std::wstring const &path) = 0;
+
+	///returns when the file was last modified (platform units, only ever compared for equality), or -1 if it can't be told
+	virtual long long modified_time(std::wstring const &path) = 0;
+
+	///opens the file for binary reading, returns nullptr if it can't be opened
+	virtual std::unique_ptr<media_file> open(std::wstring const &path) = 0;
+
+	///deletes the file, returns false on failure
+	virtual bool remove(std::wstring const &path) = 0;
+
+	///replaces path with a hard link to target, returns false on failure (path is left as it was)
+	virtual bool link(std::wstring const &target, std::wstring const &path) = 0;
+
+	///reads each file of paths whole into buffer, one after another, calling done(index, length) after each (length is -1 if it can't be read)
+	///files longer than buffer_length are cut short, backends may overlap the opens and reads of the whole batch
+	virtual void read_whole_files(std::vector<std::wstring> const &paths, char *buffer, long long buffer_length, std::function<void(size_t, long long)> const &done);
+
+	///asks the filesystem to store each extent of path once, shared with the same bytes of source, returns the number of bytes now shared
+	///the filesystem compares the ranges itself and skips any that differ, backends without shared extents share nothing
+	virtual long long share_extents(std::wstring const &source, std::wstring const &path, std::vector<shared_extent> const &extents);
+};
+
+///the real filesystem (POSIX calls, or the wide character CRT on windows)
+class native_filesystem : public media_filesystem
+{
+public:
+	void walk(std::wstring const &root, std::function<void(std::wstring const &)> const &visit) override;
+	long long file_size(std::wstring const &path) override;
+	long long modified_time(std::wstring const &path) override;
+	std::unique_ptr<media_file> open(std::wstring const &path) override;
+	bool remove(std::wstring const &path) override;
+	bool link(std::wstring const &target, std::wstring const &path) override;
+#ifndef _WIN32
+	void read_whole_files(std::vector<std::wstring> const &paths, char *buffer, long long buffer_length, std::function<void(size_t, long long)> const &done) override;
+#endif
+#ifdef __linux__
+	long long share_extents(std::wstring const &source, std::wstring const &path, std::vector<shared_extent> const &extents) override;
+#endif
+};
+
+///deterministic in-memory library described by a corpus_config, file contents are generated on every read so nothing is stored
+///file n lives at <root>/dir_x/.../file_n<ext>, which lets paths be resolved without a lookup table
+class synthetic_filesystem : public media_filesystem
+{
+public:
+	///one generated file (16 bytes, so tens of millions fit in memory)
+	struct synthetic_entry
+	{
+		int filesize;
+		int directory; //index into directories
+		unsigned int header_seed; //seed for the first bytes_to_hash bytes
+		unsigned int content_seed; //seed for the rest of the file
+	};
+
+	std::wstring root;
+	std::vector<std::wstring> directories;
+	std::vector<synthetic_entry> entries;
+	std::unique_ptr<std::atomic<bool>[]> removed;
+	int duplicates; //number of entries that are exact copies of an earlier entry
+
+	synthetic_filesystem(std::wstring const &root_dir, corpus_config const &config);
+
+	///returns the 8 bytes of the given entry starting at offset word_index * 8
+	static unsigned long long content_word(synthetic_entry const &entry, long long word_index);
+
+	///returns the entry index encoded in a synthetic path, or -1
+	long long entry_index(std::wstring const &path);
+
+	void walk(std::wstring const &root_dir, std::function<void(std::wstring const &)> const &visit) override;
+	long long file_size(std::wstring const &path) override;
+	long long modified_time(std::wstring const &path) override;
+	std::unique_ptr<media_file> open(std::wstring const &path) override;
+	bool remove(std::wstring const &path) override;
+	bool link(std::wstring const &target, std::wstring const &path) override;
+};
+
+
+//menu functions------------------------------------------------------------
+///sets up path and console character conversion for the current platform
+void init_platform();
+
+///cleans console for menuing purposes
+void clear_console();
+
+///waits for the user to press a key
+void pause_console();
+
+///reads a line of user input as a path
+void read_path(std::wstring &path);
+//--------------------------------------------------------------------------
+
+
+//batch mode functions------------------------------------------------------
+///prints command line usage for batch mode
+void print_usage();
+
+///runs a single scan/dedupe-subdir/dedupe-all command from the command line without any prompts, returns the exit code
+int run_batch(int argc, char **argv);
+//--------------------------------------------------------------------------
+
+
+//file scan functions-------------------------------------------------------
+///takes root directory wstring as input, scans for all wanted media files
+///returns only potential duplicate files (with their hashes) into media_list, grouped by filesize in walk order
+///with subtree_copies set, directories identical to an earlier walked directory are moved there as a whole instead of into media_list
+void scan_directories(std::wstring &directorypath, int &counter, std::vector<std::pair<int, media_data>> &media_list, std::vector<subtree_copy> *subtree_copies);
+
+///scan_directories and split_map helper function: one pass over sorted keys, appends the [first, last) range of every run of at least min_length equal keys
+///keys are equal when their filesizes match (and their hashes, if match_hash is set)
+void find_duplicates(std::vector<std::pair<int, int>> &runs, std::vector<group_key> &keys, bool match_hash, int min_length);
+
+///orders group keys by filesize, then hash, then record
+bool group_key_less(group_key const &key1, group_key const &key2);
+
+///sorts keys with group_key_less, as a parallel sample sort over thread_count threads when there are enough of them
+void sort_group_keys(std::vector<group_key> &keys);
+
+///get hash value (partial) of selected file
+double get_hash(std::wstring filepath, int filesize);
+
+///scan_directories helper function: hashes the files of every run and moves them into return_list
+void process_entries(std::vector<std::pair<int, int>> &runs_of_duplicates, std::vector<group_key> &keys, std::vector<std::pair<int, media_data>> &initial_read, std::vector<std::pair<int, media_data>> &return_list);
+
+///separates the scanned list into one vector per (filesize, hash) group to allow multithreading, the records are moved out and the list is left empty
+void split_map (std::vector<std::vector<std::pair<int, media_data>>> &media_vector_vector, std::vector<std::pair<int, media_data>> &media_list_to_split);
+//--------------------------------------------------------------------------
+
+
+//content digest functions--------------------------------------------------
+///SHA-256 of data, written to digest
+void sha256(char const *data, size_t length, unsigned char digest[32]);
+
+///SHA-256 of a whole file read in pooled chunks, returns false if it can't be read in full
+bool hash_whole_file(std::wstring const &path, long long filesize, unsigned char digest[32]);
+
+///reads the given initial_read records whole (all below small_file_size), in batches of small_file_batch across thread_count threads
+///files with equal contents get the same digest_id, which is also their fhash, so no comparison is needed before removing them
+void hash_small_files(std::vector<int> &records, std::vector<std::pair<int, media_data>> &initial_read);
+//--------------------------------------------------------------------------
+
+
+//directory digest functions------------------------------------------------
+///groups the walked files by directory and moves the files of every subtree identical to an earlier walked subtree out of initial_read into copies
+///only directories whose (name, size) shape is shared with another directory have their files read, the rest cost one hash per entry
+void collapse_identical_subtrees(std::wstring &root_dir, std::vector<std::pair<int, media_data>> &initial_read, std::vector<subtree_copy> &copies);
+
+///collapse_identical_subtrees helper function: returns the node of the given directory, creating it and any missing parents below root_dir
+int directory_node_index(std::vector<directory_node> &nodes, std::unordered_map<std::wstring, int> &node_index, std::wstring const &root_dir, std::wstring const &directory);
+
+///writes every copy to report (subtree<TAB>kept subtree) if given, and removes their files if remove_files is set
+void handle_subtree_copies(std::vector<subtree_copy> &copies, bool remove_files, int &removed, std::ostream *report);
+//--------------------------------------------------------------------------
+
+
+//deletion via subdirectory functions---------------------------------------
+///multithread manager function: deletes duplicate media files from selected subdirectory from entire directory
+void selected_duplicate_deletion(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::wstring &media_dir, int &counter);
+
+///reads the given directory and fills the given list with data from all valid files within
+void load_subdirectory(std::wstring &directory, std::vector<std::pair<int, media_data>> &sub_list);
+
+///selected_duplicate_deletion helper function: spreads deletion work between multiple threads defined within selected_duplicate_deletion
+void remove_selected_duplicates_from_subvectors(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::vector<std::pair<int, int>> &groups_by_filesize, std::vector<std::vector<std::pair<int, media_data>>> &sub_media_vector, std::vector<int> &indices, int &counter, int thread_slot);
+
+//deletion of all duplicate media files in directory functions---------------
+///multithread manager function: deletes all duplicate media files from entire directory
+///with groups_distinct set, each group's entry is set to 1 when every pair of its remaining files was compared (or known) and found different
+void full_duplicate_deletion(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, int &counter, std::vector<char> *groups_distinct);
+
+///full_duplicate_deletion helper function: spreads deletion work between multiple threads defined within full_duplicate_deletion
+void remove_all_duplicates_from_subvectors(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::vector<int> &indices, int &counter, int thread_slot, std::vector<char> *groups_distinct);
+
+///remove_duplicates_from_subvectors helper function: scans given vector for given iterator, deletes if found
+void sync_vectors(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, int &index, std::vector<std::pair<int, media_data>>::iterator &mt);
+//--------------------------------------------------------------------------
+
+
+//pipelined deletion functions----------------------------------------------
+///runs walk -> size bucketing -> sampling hash -> full verify -> action as concurrent stages joined by bounded queues
+///every file byte identical to an earlier walked file is removed, or only written to report (duplicate<TAB>original) when remove_duplicates is false
+///a size bucket flows downstream as soon as it has a second member, so results start arriving while the walk is still running
+void pipelined_duplicate_deletion(std::wstring &media_dir, bool remove_duplicates, int &counter, int &removed, std::ostream *report);
+//--------------------------------------------------------------------------
+
+
+//daemon functions----------------------------------------------------------
+///walks root into the daemon index, hashing the files that share a filesize
+void build_daemon_index(daemon_index &index, std::wstring &root_dir, int &counter);
+
+///checks the library files of filesize for one byte identical to path, returns true and fills match if one is found
+bool find_in_index(daemon_shard const &shard, int filesize, std::wstring const &path, std::wstring &match);
+
+///handles one daemon request, match is filled with the library file for daemon_duplicate
+daemon_status handle_daemon_request(daemon_index &index, char op, std::wstring const &path, std::wstring &match);
+
+///builds the index from root and answers lookup, ingest and delete requests on a Unix domain socket until SIGINT or SIGTERM, returns the exit code
+int run_daemon(std::wstring &root_dir, std::string const &socket_path);
+//--------------------------------------------------------------------------
+
+
+//ingest functions----------------------------------------------------------
+///fills library with the filesize, sample hash and path of every media file below root_dir, except files below incoming_dir
+///when index_path names an existing file it is loaded instead, otherwise the scan is saved there for the next ingest
+void build_library_index(std::wstring &root_dir, std::wstring &incoming_dir, std::string const &index_path, int &counter, std::multimap<int, media_data> &library);
+
+///checks every media file below incoming_dir against library, removing (or hard linking when link_duplicates is set) the ones the library already has
+///the library is only read for files that pass the Bloom filter, each verified duplicate is written to report as incoming<TAB>library
+void ingest_directory(std::wstring &incoming_dir, std::multimap<int, media_data> &library, bool link_duplicates, int &counter, int &handled, std::ostream *report);
+
+///returns directory the way paths walked from root_dir spell it (root_dir joined with its relative path), or an empty string if it isn't root_dir or below it
+std::wstring walked_directory(std::wstring &root_dir, std::wstring &directory);
+
+///true if path is directory or anything below it, compared as spelled
+bool path_is_below(std::wstring const &path, std::wstring const &directory);
+
+///reads db file into multimap, returns false and leaves it empty if the file is corrupt or truncated
+bool read_database(std::string const &db, std::multimap<int, media_data> &media_map);
+
+///writes multimap to db file, returns false if it can't be written
+bool write_map_to_db(std::string const &db, std::multimap<int, media_data> &media_map);
+
+///reads an ingest index file into indexed (keyed by walked path), returns false and leaves it empty if the file is corrupt, truncated or an older format
+bool read_library_index(std::string const &index_path, std::unordered_map<std::wstring, indexed_file> &indexed);
+
+///writes the library files and their modification times (modified[i] belongs to files[i]) to an ingest index file, returns false if it can't be written
+bool write_library_index(std::string const &index_path, std::vector<std::pair<int, media_data>> const &files, std::vector<long long> const &modified);
+//--------------------------------------------------------------------------
+
+
+//shard functions-----------------------------------------------------------
+///hashes every media file below root_dir whole and writes (filesize, SHA-256, root relative path) records to shard_path, returns false if it can't be written
+bool export_shard(std::wstring &root_dir, std::string const &host, std::string const &shard_path, int &counter);
+
+///reads a shard written by export_shard, returns false if it is missing or malformed
+bool read_shard(std::string const &shard_path, std::string &host, std::vector<shard_record> &records, int host_index);
+
+///joins the shards on (SHA-256, filesize), keeping the first copy of each file by shard order and then path
+///writes <host>.plan into plan_dir for every host that has copies to remove, returns false on a read or write error
+bool merge_shards(std::vector<std::string> const &shard_paths, std::string const &plan_dir, int &groups, int &removals, long long &bytes);
+
+///removes the files a plan lists below root_dir, each only after re-hashing it locally and finding the planned size and digest
+bool apply_plan(std::wstring &root_dir, std::string const &plan_path, bool dry_run, int &removed, int &skipped);
+
+///true if a plan path stays below the root it is joined to, so not empty, not absolute and without ".." components
+bool is_relative_plan_path(std::string const &plan_path);
+
+///lower case hex of a digest
+std::string digest_hex(std::array<unsigned char, 32> const &digest);
+//--------------------------------------------------------------------------
+
+
+//chunk overlap functions---------------------------------------------------
+///splits every media file of at least cdc_min_file_size below root_dir into content-defined chunks, across thread_count threads
+///writes "percent<TAB>file<TAB>earlier file" to report for every file sharing at least min_overlap percent of its bytes with an earlier file
+///with share_extents set, the shared ranges of those files are handed to the filesystem to be stored once
+void analyse_chunk_overlap(std::wstring &root_dir, int min_overlap, bool share_extents, int &counter, int &overlapping, std::ostream *report);
+
+///returns the rolling hash's table of 256 fixed pseudo random words
+unsigned long long const *gear_table();
+
+///analyse_chunk_overlap helper function: streams the file through a pooled buffer and appends its chunks, returns false if it can't be read in full
+bool chunk_file(std::wstring const &path, long long filesize, int file, std::vector<chunk_entry> &chunks);
+//--------------------------------------------------------------------------
+
+
+//distinct cache functions--------------------------------------------------
+///loads the distinct cache into cache (keyed by path_id), a missing file is an empty cache, returns false if it can't be read
+bool read_distinct_cache(std::string const &cache_path, std::unordered_map<unsigned long long, distinct_record> &cache);
+
+///sets distinct_set on every member of a multi-file group whose cached size and modification time still match
+///cache is replaced by this run's size and modification time of each of those members, ready for write_distinct_cache
+void apply_distinct_cache(std::unordered_map<unsigned long long, distinct_record> &cache, std::vector<std::vector<std::pair<int, media_data>>> &media_vector);
+
+///writes one set for each group whose remaining files full_duplicate_deletion proved different, returns false if the file can't be written
+bool write_distinct_cache(std::string const &cache_path, std::unordered_map<unsigned long long, distinct_record> &cache, std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::vector<char> &groups_distinct);
+
+///64 bit FNV-1a of the UTF-8 path
+unsigned long long path_id(std::wstring const &path);
+//--------------------------------------------------------------------------
+
+
+//shared functions----------------------------------------------------------
+///performs byte by byte comparison on given media_files to confirm they are identical
+///returns 1 if true, 0 if false, and -1 or -2 if a read error occurs on file1 or file2 respectively
+int match_media_files(int &filesize, std::wstring &file1, std::wstring &file2);
+
+///used by get_hash to clear local buffer
+void clear_buffer(int &filesize, char *buffer1);
+//--------------------------------------------------------------------------
+
+
+//filesystem backend functions----------------------------------------------
+///returns true if the path has one of the supported media extensions
+bool is_media_file(std::wstring const &path);
+
+///returns true if the path has a video container extension, overlap analysis reads these on top of the media extensions
+bool is_video_file(std::wstring const &path);
+//--------------------------------------------------------------------------
+
+
+//buffer pool functions-----------------------------------------------------
+///parses a byte count with an optional K, M or G suffix, throws std::invalid_argument on bad input
+///and std::out_of_range for a negative count or one that doesn't fit a size_t once the suffix is applied
+long long parse_size(std::string const &value);
+//--------------------------------------------------------------------------
+
+
+//run metrics functions----------------------------------------------------
+///zeroes every counter and histogram and restarts the run clock
+void reset_metrics();
+
+///moves the run into the given stage, stage_total of 0 means the amount of work is unknown (directory walk)
+void set_stage(int stage, long long stage_total);
+
+///adds a value to a histogram (bucket n holds values in [2^(n-1), 2^n))
+void record_value(log2_histogram &histogram, long long value);
+
+///returns the upper bound of the bucket holding the given percentile (0.0 - 1.0)
+long long histogram_percentile(log2_histogram &histogram, double percentile);
+
+///starts the background thread that prints a live progress line with rate and ETA
+void start_progress();
+
+///stops the progress thread and finishes the progress line
+void stop_progress();
+
+///writes a machine-readable JSON summary of the current metrics
+void write_run_summary(std::ostream &out, std::string const &run_name, long long ms_taken);
+
+///stops progress reporting and writes the run summary to summary_path
+void finish_run(std::string const &run_name, long long ms_taken);
+//--------------------------------------------------------------------------
+
+
+//timeline tracing functions------------------------------------------------
+///returns the calling thread's trace ring, claiming a free one (or creating one) on first use
+trace_ring &thread_trace_ring();
+
+///names the calling thread in the trace viewer
+void set_trace_thread_name(std::string const &thread_name);
+
+///writes all recorded spans as a Chrome trace (viewable in chrome://tracing or ui.perfetto.dev)
+///must be called between runs, while no worker threads are recording
+bool write_trace(std::string const &file);
+//--------------------------------------------------------------------------
+
+
+//benchmark functions-------------------------------------------------------
+///writes the synthetic library described by config to disk under root, returns the number of exact duplicate files written
+int generate_corpus(boost::filesystem::path const &root, corpus_config const &config);
+
+///returns the given percentile (0.0 - 1.0) of samples, sorts samples
+long long sample_percentile(std::vector<long long> &samples, double percentile);
+
+///prints one row of the benchmark table
+void print_benchmark_result(std::string const &stage, long long items, long long bytes, long long us_taken, std::vector<long long> &latency_us);
+
+///benchmark entry point: generates a corpus and times each stage against it (MEDIA_BENCHMARK builds only)
+int run_benchmarks(int argc, char **argv);
+//--------------------------------------------------------------------------
+
+
+//test functions------------------------------------------------------------
+///a synthetic file for the tests, files with equal seeds hold equal bytes
+struct test_file
+{
+	int directory; //0 is root, 1.. are its subdirectories dir_1..
+	int filesize;
+	unsigned int header_seed; //the first bytes_to_hash bytes, what get_hash sees
+	unsigned int content_seed; //everything after them
+};
+
+///counts and prints a failed check, returns passed
+bool check(bool passed, std::string const &what);
+
+///builds a synthetic filesystem below root holding exactly files, in directories dir_1 to dir_<directory_count>
+std::unique_ptr<synthetic_filesystem> make_test_filesystem(std::wstring const &root, int directory_count, std::vector<test_file> const &files);
+
+///SHA-256 against the FIPS 180-2 example messages, in one piece and fed in uneven pieces
+void test_sha256();
+
+///sort_group_keys against std::sort with group_key_less, for presorted input and both sides of parallel_sort_threshold
+void test_sort_group_keys();
+
+///every key inserted into a bloom_filter must be reported as possibly present
+void test_bloom_filter();
+
+///chunk boundaries before an edit never move, and an insertion only moves the boundaries near it
+void test_chunk_boundaries();
+
+///deletion over synthetic files: small file digests, scans accumulated into one list, header collisions, unsorted groups in selected deletion
+void test_deletion();
+
+///checks on the input validation the batch commands rely on (parse_size, is_relative_plan_path)
+void test_input_validation();
+
+///test entry point: runs every test, returns 0 if all checks passed and 1 otherwise (MEDIA_TESTS builds only)
+int run_tests();
+//--------------------------------------------------------------------------
+
+
+//currently unused functions------------------------------------------------
+void debug();
+//--------------------------------------------------------------------------
+
+
+//default max_file_size, files are compared in pooled chunks so raising it no longer costs RAM
+#define buffer_size 75000000 //75MB
+//note: filesize is stored in an integer, so the largest file that can be handled is 2147483647byes (2048MB or 2GB)
+
+//the number of bytes to compute during file hashing
+#define bytes_to_hash 30000 //.03MB of char space (larger numbers cause significant performance drops on file read and are unnecessary)
+
+//required to stop threads from running over each other when removing files
+std::mutex deletion_mutex;
+
+//every small file digest read so far mapped to its digest_id, kept for the whole process so ids from separate scans never collide
+std::map<std::array<unsigned char, 32>, int> small_digest_ids;
+std::mutex small_digest_mutex;
+
+//every file access goes through media_fs, which is the real filesystem unless a benchmark swaps in a synthetic one
+native_filesystem native_fs;
+media_filesystem *media_fs = &native_fs;
+
+run_metrics metrics;
+
+//progress reporter state
+std::thread progress_thread;
+std::mutex progress_mutex;
+std::condition_variable progress_signal;
+bool progress_running = false;
+bool progress_drawn = false; //the line has been printed at least once, so stop_progress has to end it
+
+//tracing state, rings are kept after their threads exit so a trace can be written after a run
+std::mutex trace_mutex;
+std::vector<trace_ring*> trace_rings;
+const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+//number of comparison threads used by both deletion modes (--threads in batch mode)
+int thread_count = 4;
+
+//files larger than this are skipped (--max-file-size), comparison reads files in chunks so any size that fits in an int works
+int max_file_size = buffer_size;
+
+//read buffers are pooled, page aligned chunks between these sizes
+#define min_chunk_size 65536 //64KB, always larger than bytes_to_hash
+#define max_chunk_size 67108864 //64MB
+#define buffer_alignment 4096
+
+//total memory hashing and comparison may hold in read buffers at once (--memory-budget)
+long long memory_budget = 268435456; //256MB
+
+buffer_pool read_pool;
+
+//candidates smaller than this are read whole once and grouped by SHA-256 instead of sampled and compared, must not exceed min_chunk_size
+#define small_file_size 65536
+
+//small files read by one backend call, so their opens and readahead overlap
+#define small_file_batch 64
+
+//fewer group keys than this are sorted on the calling thread
+#define parallel_sort_threshold 65536
+
+//samples taken per bucket when choosing the parallel sort's splitters
+#define sort_samples_per_bucket 64
+
+//capacity of each queue between pipeline stages, a full queue blocks the stage feeding it
+#define pipeline_queue_size 1024
+
+//how often blocked daemon threads check whether the daemon is stopping
+#define daemon_poll_ms 200
+
+//where finish_run writes the JSON summary (--summary in batch mode)
+std::string summary_path = summary_file;
+
+//checks that failed so far in a test build
+int failed_checks = 0;
+
+//benchmark builds replace the interactive menu with the benchmark suite, test builds with the test suite
+#ifdef MEDIA_BENCHMARK
+int main(int argc, char **argv)
+{
+	init_platform();
+
+	return run_benchmarks(argc, argv);
+}
+#elif defined(MEDIA_TESTS)
+int main(int argc, char **argv)
+{
+	init_platform();
+
+	return run_tests();
+}
+#else
+int main(int argc, char **argv)
+{
+	//std::string const db = "media.db"; //static database location, loaded on startup and saved on return (currently unused)
+	//std::wofstream ofile; //ofstream for db file
+	std::vector<std::pair<int, media_data>> media_list; //list in the form <int, double, string>, <filesize, file hash, filepath>, of potential duplicates
+	std::vector<std::vector<std::pair<int, media_data>>> media_vector; //contains list from above grouped by filesize and hash for thread safety
+	std::wstring media_dir; //user input media directories (root and sub)
+	int input = 0; //user menu input
+	int counter = 0; //counter for files scanned/deleted
+
+	init_platform();
+
+	set_trace_thread_name("main");
+
+	read_pool.configure(memory_budget, thread_count);
+
+	//any arguments run a single batch command instead of the menu
+	if (1 < argc)
+		return run_batch(argc, argv);
+
+	//console control menu
+	while (true)
+	{
+		switch (input)
+		{
+		//main menu
+		case 0:
+		{
+			clear_console();
+
+			//prompt user
+			//std::cout << "Duplicate Media Remover.\n";
+			std::cout << "This program will remove duplicate files with a filesize less than " << max_file_size/1000000 << "MB\n";
+			std::cout << "(it is recommended to run 2 on all important folders before moving to 3)\n";
+			std::cout << "-----------------------------------------------------------------------\n\n";
+			std::cout << "1: choose root media file directory\n\n";
+			std::cout << "2: remove duplicates from subdirectory (used to preserve file structure)\n\n";
+			std::cout << "3: remove duplicates from entire directory (does not preserve file structure)\n\n";
+			std::cout << "4: exit program\n\n";
+			std::cout << "5: write timeline trace of previous runs (" << trace_file << ")\n";
+			std::cout << "\n\nInput: ";
+			std::cin >> input;
+			break;
+		}
+
+		//read files to db
+		case 1:
+		{
+			//delete old db values if program is reloaded but new input is selected, groups from two scans must never merge
+			media_list.clear();
+			media_vector.clear();
+
+			clear_console();
+
+			//prompt user
+			std::cout << "Scan Directory\nPlease input the filepath to the media files directory you would like to scan:\n";
+			std::cout << "for example, C:\\media\\vacation photos\n\n";
+			std::cout << "Input: ";
+
+			//mixing '>>' '<<' and getline, have to clean input
+			std::cin.clear();
+			std::cin.sync();
+			std::cin.ignore();
+
+			//read user input
+			read_path(media_dir);
+
+			//log time taken to run functions
+			auto time1 = std::chrono::high_resolution_clock::now();
+
+			reset_metrics();
+			start_progress();
+
+			//read files from directory into media_list (only retains files that have potential duplicates)
+			//identical subtrees aren't collapsed here, options 2 and 3 both run on this scan and option 2 must see every copy
+			scan_directories(media_dir, counter, media_list, nullptr);
+
+			//group list into vector array
+			split_map(media_vector, media_list);
+
+			auto time2 = std::chrono::high_resolution_clock::now();
+
+			auto ms_taken = std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1);
+
+			finish_run("scan", ms_taken.count());
+
+			std::cout << "\nScanned " << counter << " files in " << ms_taken.count() << "ms\n\n";
+			
+			//reset variables
+			counter = 0;
+			input = 0;
+			
+			//wait for user recognition
+			pause_console();
+			break;
+		}
+
+		//delete media_files from entire directory with final copies ending in selected subdirectory
+		case 2:
+		{
+			clear_console();
+
+			//prompt user
+			std::cout << "Please select a subdirectory\n";
+			std::cout << "   The given directory will be scanned for all valid media files\n";
+			std::cout << "   Those files will then be compared against files in the root directory\n";
+			std::cout << "   Duplicate files will be removed\n";
+			std::cout << "   The remaining file will remain in the selected subdirectory\n\n";
+			std::cout << "Input: ";
+
+
+			//mixing '>>' '<<' and getline, have to clean input
+			std::cin.clear();
+			std::cin.sync();
+			std::cin.ignore();
+
+			//read user input
+			read_path(media_dir);
+
+			//run function and log time
+			auto time1 = std::chrono::high_resolution_clock::now();
+
+			reset_metrics();
+			start_progress();
+
+			selected_duplicate_deletion(media_vector, media_dir, counter);
+
+			auto time2 = std::chrono::high_resolution_clock::now();
+
+			auto ms_taken = std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1);
+
+			finish_run("dedupe-subdir", ms_taken.count());
+
+			std::cout << "\nAction completed. " << counter << " duplicate media files were removed in " << ms_taken.count() << "ms\n\n";
+
+			//reset variables
+			counter = 0;
+			input = 0;
+
+			//wait for user recognition
+			pause_console();
+			break;
+		}
+
+		//delete all redundant media_files
+		case 3:
+		{
+			clear_console();
+
+			std::cout << "Full redundant media files scan.\n\n";
+
+			//run function and log times
+			auto time1 = std::chrono::high_resolution_clock::now();
+
+			reset_metrics();
+			start_progress();
+
+			full_duplicate_deletion(media_vector, counter, nullptr);
+
+			auto time2 = std::chrono::high_resolution_clock::now();
+
+			auto ms_taken = std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1);
+
+			finish_run("dedupe-all", ms_taken.count());
+
+			std::cout << "\nAction completed. " << counter << " duplicate media files were removed in " << ms_taken.count() << "ms\n\n\n";
+
+			//reset variables
+			counter = 0;
+			input = 0;
+
+			//drop the newline left behind by the menu input, then wait for user recognition
+			std::cin.ignore();
+			pause_console();
+			break;
+		}
+
+		//exit program
+		case 4:
+		{
+			//write db file on exit to allow speedier startup if user has to stop midway
+			//write_map_to_db(db, media_map);
+
+			return 0;
+		}
+
+		//dump per-thread timelines
+		case 5:
+		{
+			clear_console();
+
+			if (write_trace(trace_file))
+				std::cout << "Timeline trace written to " << trace_file << ", open it in chrome://tracing or ui.perfetto.dev\n\n";
+			else
+				std::cout << "Unable to write " << trace_file << "\n\n";
+
+			input = 0;
+
+			//drop the newline left behind by the menu input, then wait for user recognition
+			std::cin.ignore();
+			pause_console();
+			break;
+		}
+
+		//ask again if non-menu item is chosen
+		default:
+			input = 0;
+		}
+	}
+}
+#endif
+
+//menu functions------------------------------------------------------------
+void init_platform()
+{
+#ifndef _WIN32
+	//paths are kept as wstrings, convert them to and from UTF-8 when talking to the OS
+	boost::filesystem::path::imbue(std::locale(std::locale(), new std::codecvt_utf8<wchar_t>));
+#endif
+}
+
+void clear_console()
+{
+	std::cin.clear();
+#ifdef _WIN32
+	system("cls");
+#else
+	std::cout << "\033[2J\033[H" << std::flush;
+#endif
+}
+
+void read_path(std::wstring &path)
+{
+#ifdef _WIN32
+	std::getline(std::wcin, path);
+#else
+	//stdin is byte oriented once std::cin has used it, so read UTF-8 and convert
+	std::string line;
+
+	std::getline(std::cin, line);
+	path = boost::filesystem::path(line).wstring();
+#endif
+}
+
+void pause_console()
+{
+#ifdef _WIN32
+	system("PAUSE");
+#else
+	std::cout << "Press Enter to continue . . . " << std::flush;
+	std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+#endif
+}
+//--------------------------------------------------------------------------
+
+
+//file scan functions-------------------------------------------------------
+void scan_directories(std::wstring &directorypath, int &counter, std::vector<std::pair<int, media_data>> &media_list, std::vector<subtree_copy> *subtree_copies)
+{
+	std::vector<std::pair<int, media_data>> initial_read; //every wanted file in walk order, only candidates get hashed
+	std::vector<group_key> keys; //one compact (filesize, record) key per file in initial_read
+	std::vector<std::pair<int, int>> runs_of_duplicates; //[first, last) ranges of keys with more than one file of that filesize
+	trace_span span("scan");
+
+	set_stage(stage_walk, 0);
+
+	//recursively iterate all directories and scan for all wanted filetypes
+	media_fs->walk(directorypath, [&](std::wstring const &filepath)
+	{
+		counter++; //number of files read
+		metrics.files_walked++;
+		metrics.stage_done++;
+
+		//check if file is appropriate type
+		if (is_media_file(filepath))
+		{
+			long long filesize = media_fs->file_size(filepath);
+
+			//check if the current file is small enough to be compared
+			if (0 <= filesize && filesize <= max_file_size)
+			{
+				//record filesize and path if it is appropriate type
+				initial_read.push_back({ (int)filesize, { 0, filepath, 0, 0 } });
+			}
+			else if (0 <= filesize) metrics.skipped_too_large++;
+			else metrics.skipped_read_error++;
+		}
+		else metrics.skipped_extension++;
+	});
+
+	//whole copied folders are handled as one unit before any file is sized up against the others
+	if (subtree_copies)
+		collapse_identical_subtrees(directorypath, initial_read, *subtree_copies);
+
+	//sort compact keys instead of the records themselves, hashes are still unknown so only filesize orders them
+	keys.reserve(initial_read.size());
+
+	for (int i = 0; i < initial_read.size(); i++)
+		keys.push_back({ 0, initial_read[i].first, i });
+
+	sort_group_keys(keys);
+
+	//find every filesize shared by more than one file
+	find_duplicates(runs_of_duplicates, keys, false, 2);
+
+	//count files that will be hashed, everything else has a unique filesize
+	for (int i = 0; i < runs_of_duplicates.size(); i++)
+		metrics.files_candidate += runs_of_duplicates[i].second - runs_of_duplicates[i].first;
+
+	metrics.skipped_unique_size += initial_read.size() - metrics.files_candidate;
+
+	//hash the candidates and move them into media_list
+	process_entries(runs_of_duplicates, keys, initial_read, media_list);
+}
+
+void find_duplicates(std::vector<std::pair<int, int>> &runs, std::vector<group_key> &keys, bool match_hash, int min_length)
+{
+	int first = 0;
+
+	//keys are sorted, so equal keys sit next to each other and one linear pass finds every run
+	for (int i = 1; i <= keys.size(); i++)
+	{
+		if (i < keys.size() && keys[i].filesize == keys[first].filesize && (!match_hash || keys[i].fhash == keys[first].fhash))
+			continue;
+
+		if (min_length <= i - first)
+			runs.push_back({ first, i });
+
+		first = i;
+	}
+}
+
+bool group_key_less(group_key const &key1, group_key const &key2)
+{
+	if (key1.filesize != key2.filesize)
+		return key1.filesize < key2.filesize;
+
+	if (key1.fhash != key2.fhash)
+		return key1.fhash < key2.fhash;
+
+	return key1.record < key2.record;
+}
+
+void sort_group_keys(std::vector<group_key> &keys)
+{
+	int buckets = thread_count; //one bucket (and one thread) per comparison thread
+	trace_span span("sort");
+
+	//lets std::sort inline the comparison
+	auto key_less = [](group_key const &key1, group_key const &key2) { return group_key_less(key1, key2); };
+
+	//scan_directories already returns its files in filesize order, then only each run of one filesize needs sorting
+	if (std::is_sorted(keys.begin(), keys.end(), [](group_key const &key1, group_key const &key2) { return key1.filesize < key2.filesize; }))
+	{
+		for (size_t first = 0, last = 0; first < keys.size(); first = last)
+		{
+			while (last < keys.size() && keys[last].filesize == keys[first].filesize)
+				last++;
+
+			std::sort(keys.begin() + first, keys.begin() + last, key_less);
+		}
+
+		return;
+	}
+
+	if (keys.size() < parallel_sort_threshold || buckets < 2)
+	{
+		std::sort(keys.begin(), keys.end(), key_less);
+		return;
+	}
+
+	std::vector<group_key> samples, splitters, sorted(keys.size());
+	std::vector<std::vector<size_t>> offsets(buckets, std::vector<size_t>(buckets, 0)); //[slice][bucket], counts and then scatter positions
+	std::vector<size_t> bucket_start(buckets + 1, 0);
+	size_t slice = (keys.size() + buckets - 1) / buckets;
+
+	//runs body(t) for every bucket/slice t on its own thread
+	auto parallel = [&](std::function<void(int)> const &body)
+	{
+		std::vector<std::thread> threads;
+
+		for (int t = 0; t < buckets; t++)
+			threads.push_back(std::thread(body, t));
+
+		for (int t = 0; t < buckets; t++)
+			threads[t].join();
+	};
+
+	//which bucket a key belongs to, splitters are sorted so a binary search finds it
+	auto bucket_of = [&](group_key const &key)
+	{
+		return (int)(std::upper_bound(splitters.begin(), splitters.end(), key, key_less) - splitters.begin());
+	};
+
+	//evenly spaced samples give splitters that cut the keys into buckets of about equal size (keys are unique thanks to record, so there is no skew)
+	for (int i = 0; i < sort_samples_per_bucket * buckets; i++)
+		samples.push_back(keys[i * keys.size() / (sort_samples_per_bucket * buckets)]);
+
+	std::sort(samples.begin(), samples.end(), key_less);
+
+	for (int b = 1; b < buckets; b++)
+		splitters.push_back(samples[b * samples.size() / buckets]);
+
+	//count how many keys of each slice land in each bucket
+	parallel([&](int t)
+	{
+		for (size_t i = t * slice; i < keys.size() && i < (t + 1) * slice; i++)
+			offsets[t][bucket_of(keys[i])]++;
+	});
+
+	//turn the counts into positions, bucket by bucket and slice by slice so every key keeps its slice order
+	for (int b = 0; b < buckets; b++)
+	{
+		size_t position = bucket_start[b];
+
+		for (int t = 0; t < buckets; t++)
+		{
+			size_t count = offsets[t][b];
+
+			offsets[t][b] = position;
+			position += count;
+		}
+
+		bucket_start[b + 1] = position;
+	}
+
+	//scatter the keys into their buckets
+	parallel([&](int t)
+	{
+		for (size_t i = t * slice; i < keys.size() && i < (t + 1) * slice; i++)
+			sorted[offsets[t][bucket_of(keys[i])]++] = keys[i];
+	});
+
+	//every bucket only holds keys between its splitters, so sorting each one sorts the whole
+	parallel([&](int b)
+	{
+		std::sort(sorted.begin() + bucket_start[b], sorted.begin() + bucket_start[b + 1], key_less);
+	});
+
+	keys.swap(sorted);
+}
+
+double get_hash(std::wstring filepath, int filesize)
+{
+	double hash_value;
+	std::unique_ptr<media_file> ifile;
+	auto time1 = std::chrono::steady_clock::now();
+	trace_span span("hash");
+
+	//load file in binary mode
+	{
+		trace_span open_span("open");
+		ifile = media_fs->open(filepath);
+	}
+
+	//return if read fails
+	if (!ifile)
+	{
+		metrics.skipped_read_error++;
+		return -1;
+	}
+
+	//load file into memory (a leased chunk is always larger than bytes_to_hash)
+	pooled_buffers buffer(1);
+	char *local_buffer = buffer.data[0];
+
+	std::memset(local_buffer, 0, bytes_to_hash);
+
+	{
+		trace_span read_span("read");
+		metrics.bytes_hashed += ifile->read(local_buffer, bytes_to_hash);
+	}
+
+	//get hash
+	hash_value = boost::hash_range(local_buffer, local_buffer + bytes_to_hash);
+	
+	//close file
+	ifile.reset();
+
+	//clear buffer (only the hashed portion, the rest of the chunk was never written)
+	int hashed_bytes = filesize < bytes_to_hash ? filesize : bytes_to_hash;
+	clear_buffer(hashed_bytes, local_buffer);
+
+	metrics.files_hashed++;
+	record_value(metrics.hash_latency_us, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - time1).count());
+
+	//return hash value of file in buffer
+	return hash_value;
+}
+
+void process_entries(std::vector<std::pair<int, int>> &runs_of_duplicates, std::vector<group_key> &keys, std::vector<std::pair<int, media_data>> &initial_read, std::vector<std::pair<int, media_data>> &return_list)
+{
+	set_stage(stage_hash, metrics.files_candidate);
+
+	return_list.reserve(return_list.size() + metrics.files_candidate);
+
+	//runs are in filesize order, so the small files are the leading runs, they are read whole in one go instead of hashed one by one
+	std::vector<int> small_records;
+	int small_runs = 0;
+
+	for (; small_runs < runs_of_duplicates.size() && keys[runs_of_duplicates[small_runs].first].filesize < small_file_size; small_runs++)
+	{
+		for (int k = runs_of_duplicates[small_runs].first; k < runs_of_duplicates[small_runs].second; k++)
+			small_records.push_back(keys[k].record);
+	}
+
+	hash_small_files(small_records, initial_read);
+
+	for (int i = 0; i < runs_of_duplicates.size(); i++)
+	{
+		//inner loop iterates every file of the run's filesize, in walk order
+		for (int k = runs_of_duplicates[i].first; k < runs_of_duplicates[i].second; k++)
+		{
+			std::pair<int, media_data> &entry = initial_read[keys[k].record];
+
+			//get hash value of file (small files already have theirs)
+			if (small_runs <= i)
+			{
+				entry.second.fhash = get_hash(entry.second.fpath, entry.first);
+				metrics.stage_done++;
+			}
+
+			return_list.push_back(std::move(entry));
+		}
+	}
+}
+
+void split_map(std::vector<std::vector<std::pair<int, media_data>>> &media_vector_vector, std::vector<std::pair<int, media_data>> &media_list_to_split)
+{
+	//for each unique (filesize, hash) value in media_list, create a new vector to contain that keys entries
+	std::vector<group_key> keys;
+	std::vector<std::pair<int, int>> runs;
+	trace_span span("group");
+
+	//nothing to split (no potential duplicates were found)
+	if (media_list_to_split.empty())
+		return;
+
+	set_stage(stage_group, media_list_to_split.size());
+
+	keys.reserve(media_list_to_split.size());
+
+	for (int i = 0; i < media_list_to_split.size(); i++)
+		keys.push_back({ media_list_to_split[i].second.fhash, media_list_to_split[i].first, i });
+
+	sort_group_keys(keys);
+
+	//every run of equal (filesize, hash) keys is a group, single files included
+	find_duplicates(runs, keys, true, 1);
+
+	media_vector_vector.reserve(media_vector_vector.size() + runs.size());
+
+	for (int i = 0; i < runs.size(); i++)
+	{
+		std::vector<std::pair<int, media_data>> group;
+
+		group.reserve(runs[i].second - runs[i].first);
+
+		for (int k = runs[i].first; k < runs[i].second; k++)
+			group.push_back(std::move(media_list_to_split[keys[k].record]));
+
+		record_value(metrics.group_size, group.size());
+		metrics.stage_done += group.size();
+
+		media_vector_vector.push_back(std::move(group));
+	}
+
+	media_list_to_split.clear();
+}
+//--------------------------------------------------------------------------
+
+
+//content digest functions--------------------------------------------------
+sha256_state::sha256_state() : block_length(0), total_length(0)
+{
+	static const unsigned int initial[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+	std::memcpy(state, initial, sizeof(state));
+}
+
+void sha256_state::compress(unsigned char const *data)
+{
+	static const unsigned int k[64] =
+	{
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+	unsigned int w[64];
+	unsigned int a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+
+	auto rotate = [](unsigned int value, int bits) { return (value >> bits) | (value << (32 - bits)); };
+
+	for (int i = 0; i < 16; i++)
+		w[i] = (unsigned int)data[i * 4] << 24 | (unsigned int)data[i * 4 + 1] << 16 | (unsigned int)data[i * 4 + 2] << 8 | data[i * 4 + 3];
+
+	for (int i = 16; i < 64; i++)
+	{
+		unsigned int s0 = rotate(w[i - 15], 7) ^ rotate(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		unsigned int s1 = rotate(w[i - 2], 17) ^ rotate(w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	for (int i = 0; i < 64; i++)
+	{
+		unsigned int t1 = h + (rotate(e, 6) ^ rotate(e, 11) ^ rotate(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+		unsigned int t2 = (rotate(a, 2) ^ rotate(a, 13) ^ rotate(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void sha256_state::update(char const *data, size_t length)
+{
+	total_length += length;
+
+	//top up a partial block first
+	if (0 < block_length)
+	{
+		size_t take = 64 - block_length < length ? 64 - block_length : length;
+
+		std::memcpy(block + block_length, data, take);
+		block_length += take;
+		data += take;
+		length -= take;
+
+		if (64 == block_length)
+		{
+			compress(block);
+			block_length = 0;
+		}
+	}
+
+	for (; 64 <= length; data += 64, length -= 64)
+		compress((unsigned char const *)data);
+
+	std::memcpy(block + block_length, data, length);
+	block_length += length;
+}
+
+void sha256_state::finish(unsigned char digest[32])
+{
+	unsigned long long bit_length = total_length * 8;
+	unsigned char padding[72] = { 0x80 };
+
+	//pad with a 1 bit and zeros up to 56 bytes into a block, then the big endian bit length
+	size_t padding_length = block_length < 56 ? 56 - block_length : 120 - block_length;
+
+	for (int i = 0; i < 8; i++)
+		padding[padding_length + i] = (unsigned char)(bit_length >> (56 - i * 8));
+
+	update((char const *)padding, padding_length + 8);
+
+	for (int i = 0; i < 32; i++)
+		digest[i] = (unsigned char)(state[i / 4] >> (24 - (i % 4) * 8));
+}
+
+void sha256(char const *data, size_t length, unsigned char digest[32])
+{
+	sha256_state hasher;
+
+	hasher.update(data, length);
+	hasher.finish(digest);
+}
+
+bool hash_whole_file(std::wstring const &path, long long filesize, unsigned char digest[32])
+{
+	std::unique_ptr<media_file> ifile;
+	sha256_state hasher;
+	long long remaining = filesize;
+	trace_span span("hash");
+
+	{
+		trace_span open_span("open");
+		ifile = media_fs->open(path);
+	}
+
+	if (!ifile)
+	{
+		metrics.skipped_read_error++;
+		return false;
+	}
+
+	pooled_buffers buffer(1);
+
+	while (0 < remaining)
+	{
+		long long length = remaining < read_pool.chunk_size() ? remaining : read_pool.chunk_size();
+		long long count;
+
+		{
+			trace_span read_span("read");
+			count = ifile->read(buffer.data[0], length);
+		}
+
+		metrics.bytes_hashed += count;
+
+		//shorter than it was when it was sized
+		if (count < length)
+		{
+			metrics.skipped_read_error++;
+			return false;
+		}
+
+		hasher.update(buffer.data[0], (size_t)count);
+		remaining -= count;
+	}
+
+	hasher.finish(digest);
+	metrics.files_hashed++;
+
+	return true;
+}
+
+void hash_small_files(std::vector<int> &records, std::vector<std::pair<int, media_data>> &initial_read)
+{
+	std::vector<std::array<unsigned char, 32>> digests(records.size());
+	std::vector<char> readable(records.size(), 0); //not vector<bool>, threads write neighbouring entries
+	std::vector<std::thread> threads;
+	std::atomic<size_t> next(0);
+	trace_span span("small_files");
+
+	//each thread claims small_file_batch files at a time, so the backend can overlap their opens
+	for (int t = 0; t < thread_count; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			pooled_buffers buffer(1);
+			std::vector<std::wstring> paths;
+
+			set_trace_thread_name("small files " + std::to_string(t));
+
+			for (size_t first = next.fetch_add(small_file_batch); first < records.size(); first = next.fetch_add(small_file_batch))
+			{
+				size_t last = first + small_file_batch < records.size() ? first + small_file_batch : records.size();
+
+				paths.clear();
+
+				for (size_t i = first; i < last; i++)
+					paths.push_back(initial_read[records[i]].second.fpath);
+
+				media_fs->read_whole_files(paths, buffer.data[0], read_pool.chunk_size(), [&](size_t index, long long length)
+				{
+					size_t position = first + index;
+
+					metrics.stage_done++;
+
+					//a file that changed size since the walk can't be trusted to match anything
+					if (length != initial_read[records[position]].first)
+					{
+						metrics.skipped_read_error++;
+						return;
+					}
+
+					sha256(buffer.data[0], (size_t)length, digests[position].data());
+					readable[position] = true;
+
+					metrics.files_hashed++;
+					metrics.files_small++;
+					metrics.bytes_hashed += length;
+				});
+			}
+		}));
+	}
+
+	for (int t = 0; t < thread_count; t++)
+		threads[t].join();
+
+	std::lock_guard<std::mutex> lock(small_digest_mutex);
+
+	for (int i = 0; i < records.size(); i++)
+	{
+		media_data &data = initial_read[records[i]].second;
+
+		//unreadable files keep the same -1 hash get_hash gives them and get no digest_id
+		if (!readable[i])
+		{
+			data.fhash = -1;
+			continue;
+		}
+
+		//fhash becomes the digest's id, so split_map groups exactly the files with equal digests, whichever scan read them
+		data.digest_id = small_digest_ids.emplace(digests[i], (int)small_digest_ids.size() + 1).first->second;
+		data.fhash = data.digest_id;
+	}
+}
+//--------------------------------------------------------------------------
+
+
+//directory digest functions------------------------------------------------
+void collapse_identical_subtrees(std::wstring &root_dir, std::vector<std::pair<int, media_data>> &initial_read, std::vector<subtree_copy> &copies)
+{
+	std::vector<directory_node> nodes;
+	std::unordered_map<std::wstring, int> node_index;
+	std::vector<int> order; //every node, deepest paths first so children are finished before their parents
+	std::vector<std::pair<size_t, int>> shapes; //(shape, node) of every directory with enough files below it
+	std::vector<int> hash_records; //files below candidate directories
+	std::vector<int> record_slot(initial_read.size(), -1); //index into hash_records and the digests of each record
+	std::vector<std::array<unsigned char, 32>> file_digests;
+	std::vector<char> file_hashed;
+	std::vector<std::pair<std::array<unsigned char, 32>, int>> digests; //(digest, node) of every hashed candidate
+	std::vector<std::pair<int, int>> groups; //[first, last) ranges of digests shared by more than one directory
+	std::vector<char> collapsed(initial_read.size(), 0);
+	std::vector<std::thread> threads;
+	std::atomic<size_t> next(0);
+	trace_span span("subtrees");
+
+	set_stage(stage_subtree, initial_read.size());
+
+	for (int i = 0; i < initial_read.size(); i++)
+	{
+		int node = directory_node_index(nodes, node_index, root_dir, boost::filesystem::path(initial_read[i].second.fpath).parent_path().wstring());
+
+		nodes[node].files.push_back(i);
+		metrics.stage_done++;
+	}
+
+	for (int n = 0; n < nodes.size(); n++)
+		order.push_back(n);
+
+	std::sort(order.begin(), order.end(), [&](int node1, int node2) { return nodes[node1].path.size() > nodes[node2].path.size(); });
+
+	//shapes bottom up, a directory's entries are hashed in sorted order since the walk order within a directory isn't fixed
+	for (int i = 0; i < order.size(); i++)
+	{
+		directory_node &node = nodes[order[i]];
+		std::vector<size_t> entries;
+
+		node.first_record = std::numeric_limits<int>::max();
+		node.file_count = node.files.size();
+
+		for (int f = 0; f < node.files.size(); f++)
+		{
+			size_t entry = boost::hash_value(boost::filesystem::path(initial_read[node.files[f]].second.fpath).filename().wstring());
+
+			boost::hash_combine(entry, initial_read[node.files[f]].first);
+			entries.push_back(entry);
+			node.first_record = std::min(node.first_record, node.files[f]);
+		}
+
+		for (int c = 0; c < node.children.size(); c++)
+		{
+			directory_node &child = nodes[node.children[c]];
+			size_t entry = boost::hash_value(boost::filesystem::path(child.path).filename().wstring());
+
+			boost::hash_combine(entry, child.shape);
+			entries.push_back(entry);
+			node.file_count += child.file_count;
+			node.height = std::max(node.height, child.height + 1);
+			node.first_record = std::min(node.first_record, child.first_record);
+		}
+
+		std::sort(entries.begin(), entries.end());
+		node.shape = boost::hash_range(entries.begin(), entries.end());
+
+		if (subtree_min_files <= node.file_count)
+			shapes.push_back({ node.shape, order[i] });
+	}
+
+	std::sort(shapes.begin(), shapes.end());
+
+	//a shape shared with another directory makes the directory and everything below it a candidate
+	for (int i = 0; i < shapes.size(); i++)
+	{
+		if ((0 < i && shapes[i - 1].first == shapes[i].first) || (i + 1 < shapes.size() && shapes[i + 1].first == shapes[i].first))
+			nodes[shapes[i].second].candidate = true;
+	}
+
+	for (int i = (int)order.size() - 1; 0 <= i; i--)
+	{
+		directory_node &node = nodes[order[i]];
+
+		if (!node.candidate && 0 <= node.parent && nodes[node.parent].candidate)
+			node.candidate = true;
+
+		if (!node.candidate)
+			continue;
+
+		for (int f = 0; f < node.files.size(); f++)
+		{
+			record_slot[node.files[f]] = (int)hash_records.size();
+			hash_records.push_back(node.files[f]);
+		}
+	}
+
+	//no directory looks like another, so nothing has to be read
+	if (hash_records.empty())
+		return;
+
+	set_stage(stage_hash, hash_records.size());
+	file_digests.resize(hash_records.size());
+	file_hashed.assign(hash_records.size(), 0);
+
+	for (int t = 0; t < thread_count; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			set_trace_thread_name("subtree " + std::to_string(t));
+
+			for (size_t i = next++; i < hash_records.size(); i = next++)
+			{
+				std::pair<int, media_data> &entry = initial_read[hash_records[i]];
+
+				file_hashed[i] = hash_whole_file(entry.second.fpath, entry.first, file_digests[i].data());
+				metrics.stage_done++;
+			}
+		}));
+	}
+
+	for (int t = 0; t < thread_count; t++)
+		threads[t].join();
+
+	set_stage(stage_subtree, order.size());
+
+	//digests bottom up, from each entry's name, size and content (or a subdirectory's name and digest)
+	for (int i = 0; i < order.size(); i++)
+	{
+		directory_node &node = nodes[order[i]];
+		std::vector<std::string> entries;
+		sha256_state hasher;
+
+		metrics.stage_done++;
+
+		if (!node.candidate)
+			continue;
+
+		node.hashed = true;
+
+		for (int f = 0; f < node.files.size(); f++)
+		{
+			std::pair<int, media_data> &file = initial_read[node.files[f]];
+			int slot = record_slot[node.files[f]];
+			long long filesize = file.first;
+			std::string entry = "f" + boost::filesystem::path(file.second.fpath).filename().string();
+
+			entry.push_back('\0');
+			entry.append((char const *)&filesize, sizeof(filesize));
+			entry.append((char const *)file_digests[slot].data(), 32);
+			entries.push_back(entry);
+			node.hashed = node.hashed && file_hashed[slot];
+		}
+
+		for (int c = 0; c < node.children.size(); c++)
+		{
+			directory_node &child = nodes[node.children[c]];
+			std::string entry = "d" + boost::filesystem::path(child.path).filename().string();
+
+			entry.push_back('\0');
+			entry.append((char const *)child.digest.data(), 32);
+			entries.push_back(entry);
+			node.hashed = node.hashed && child.hashed;
+		}
+
+		std::sort(entries.begin(), entries.end());
+
+		for (int e = 0; e < entries.size(); e++)
+			hasher.update(entries[e].data(), entries[e].size());
+
+		hasher.finish(node.digest.data());
+
+		if (node.hashed && subtree_min_files <= node.file_count)
+			digests.push_back({ node.digest, order[i] });
+	}
+
+	std::sort(digests.begin(), digests.end());
+
+	for (int first = 0, i = 1; i <= digests.size(); i++)
+	{
+		if (i < digests.size() && digests[i].first == digests[first].first)
+			continue;
+
+		if (2 <= i - first)
+			groups.push_back({ first, i });
+
+		first = i;
+	}
+
+	//the tallest groups first: a copy's subdirectories are identical to the kept subtree's too, and must not be collapsed again on their own
+	std::sort(groups.begin(), groups.end(), [&](std::pair<int, int> const &group1, std::pair<int, int> const &group2) { return nodes[digests[group1.first].second].height > nodes[digests[group2.first].second].height; });
+
+	for (int g = 0; g < groups.size(); g++)
+	{
+		std::vector<int> members;
+		int kept = -1;
+
+		for (int k = groups[g].first; k < groups[g].second; k++)
+		{
+			int node = digests[k].second;
+
+			if (nodes[node].covered)
+				continue;
+
+			members.push_back(node);
+
+			if (-1 == kept || nodes[node].first_record < nodes[kept].first_record)
+				kept = node;
+		}
+
+		if (members.size() < 2)
+			continue;
+
+		for (int m = 0; m < members.size(); m++)
+		{
+			std::vector<int> below(1, members[m]);
+			subtree_copy copy;
+
+			if (kept == members[m])
+				continue;
+
+			copy.path = nodes[members[m]].path;
+			copy.kept = nodes[kept].path;
+
+			while (!below.empty())
+			{
+				directory_node &node = nodes[below.back()];
+
+				below.pop_back();
+				node.covered = true;
+				below.insert(below.end(), node.children.begin(), node.children.end());
+
+				for (int f = 0; f < node.files.size(); f++)
+				{
+					collapsed[node.files[f]] = 1;
+					copy.files.push_back(initial_read[node.files[f]].second.fpath);
+				}
+			}
+
+			metrics.subtrees_collapsed++;
+			metrics.files_collapsed += copy.files.size();
+
+			copies.push_back(std::move(copy));
+		}
+	}
+
+	//the collapsed files leave the per-file path, their kept twins stay in it
+	int kept_records = 0;
+
+	for (int i = 0; i < initial_read.size(); i++)
+	{
+		if (collapsed[i])
+			continue;
+
+		if (kept_records != i)
+			initial_read[kept_records] = std::move(initial_read[i]);
+
+		kept_records++;
+	}
+
+	initial_read.resize(kept_records);
+}
+
+int directory_node_index(std::vector<directory_node> &nodes, std::unordered_map<std::wstring, int> &node_index, std::wstring const &root_dir, std::wstring const &directory)
+{
+	auto found = node_index.find(directory);
+
+	if (node_index.end() != found)
+		return found->second;
+
+	directory_node node = {};
+
+	node.path = directory;
+	node.parent = -1;
+
+	//anything not longer than root_dir is the root itself (root_dir may end in a separator)
+	if (root_dir.size() < directory.size())
+		node.parent = directory_node_index(nodes, node_index, root_dir, boost::filesystem::path(directory).parent_path().wstring());
+
+	nodes.push_back(std::move(node));
+	node_index[directory] = (int)nodes.size() - 1;
+
+	if (0 <= nodes.back().parent)
+		nodes[nodes.back().parent].children.push_back((int)nodes.size() - 1);
+
+	return (int)nodes.size() - 1;
+}
+
+void handle_subtree_copies(std::vector<subtree_copy> &copies, bool remove_files, int &removed, std::ostream *report)
+{
+	for (int i = 0; i < copies.size(); i++)
+	{
+		if (report)
+			*report << boost::filesystem::path(copies[i].path).string() << "\t" << boost::filesystem::path(copies[i].kept).string() << "\n";
+
+		if (!remove_files)
+			continue;
+
+		for (int f = 0; f < copies[i].files.size(); f++)
+		{
+			trace_span unlink_span("unlink");
+
+			if (media_fs->remove(copies[i].files[f]))
+			{
+				removed++;
+				metrics.files_removed++;
+			}
+		}
+	}
+}
+//--------------------------------------------------------------------------
+
+
+//deletion via subdirectory functions---------------------------------------
+void selected_duplicate_deletion(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::wstring &media_dir, int &counter)
+{
+	std::vector<std::pair<int, media_data>> sub_list; //list for initial file read
+	std::vector<std::vector<std::pair<int, media_data>>> sub_vector; //vector of vectors to store the grouped list for thread safety
+	std::vector<std::thread> threads;
+	std::vector<std::vector<int>> thread_queues(thread_count); //queues for each running thread
+	std::vector<int> temp_counters(thread_count, 0); //counters to sum after threads run
+	std::vector<std::pair<int, int>> groups_by_filesize; //(filesize, media_vector index) of every group in filesize order, read only while the threads run
+
+
+	load_subdirectory(media_dir, sub_list);
+
+	split_map(sub_vector, sub_list);
+
+	set_stage(stage_compare, sub_vector.size());
+	metrics.threads_used = thread_count;
+
+	//media_vector holds groups in whatever order they were added, so they are looked up through a sorted copy of their filesizes
+	for (int i = 0; i < media_vector.size(); i++)
+		groups_by_filesize.push_back({ media_vector[i].empty() ? 0 : media_vector[i].front().first, i });
+
+	std::sort(groups_by_filesize.begin(), groups_by_filesize.end());
+
+	//deal groups out to the threads by filesize, so only one thread ever erases from the media_vector groups of a filesize
+	for (int i = 0; i < sub_vector.size(); i++)
+		thread_queues[sub_vector[i].front().first % thread_count].push_back(i);
+
+	//run multithreading (if thread queue isn't empty)
+	for (int t = 0; t < thread_count; t++)
+	{
+		if (thread_queues[t].empty())
+			continue;
+
+		threads.emplace_back(remove_selected_duplicates_from_subvectors, std::ref(media_vector), std::ref(groups_by_filesize), std::ref(sub_vector), std::ref(thread_queues[t]), std::ref(temp_counters[t]), t);
+	}
+
+	//join threads (if ran)
+	for (int t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	for (int t = 0; t < thread_count; t++)
+		counter += temp_counters[t];
+}
+
+void load_subdirectory(std::wstring &directory, std::vector<std::pair<int, media_data>> &sub_list)
+{
+	media_data feeder = {}; //feeds data to sub_list
+	trace_span span("scan");
+
+	set_stage(stage_walk, 0);
+
+	//scan subdirectory (and its subdirectories) into the sub_list if filetypes match
+	media_fs->walk(directory, [&](std::wstring const &filepath)
+	{
+		metrics.files_walked++;
+		metrics.stage_done++;
+
+		if (is_media_file(filepath))
+		{
+			long long filesize = media_fs->file_size(filepath);
+
+			if (0 <= filesize && filesize <= max_file_size)
+			{
+				feeder.fhash = get_hash(filepath, filesize);
+
+				feeder.fpath = filepath;
+
+				sub_list.emplace_back((int)filesize, feeder);
+
+				metrics.files_candidate++;
+			}
+			else if (0 <= filesize) metrics.skipped_too_large++;
+			else metrics.skipped_read_error++;
+		}
+		else metrics.skipped_extension++;
+	});
+}
+
+void remove_selected_duplicates_from_subvectors(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::vector<std::pair<int, int>> &groups_by_filesize, std::vector<std::vector<std::pair<int, media_data>>> &sub_media_vector, std::vector<int> &indices, int &counter, int thread_slot)
+{
+	int media_case = 0; //return value for match_media_files (-1 and -2 are read errors, 0 is no match, 1 is match)
+	auto thread_start = std::chrono::steady_clock::now();
+
+	set_trace_thread_name("deletion thread " + std::to_string(thread_slot + 1));
+
+	//iterate through indices given to the running thread
+	for (int i = 0; i < indices.size(); i++)
+	{
+		for (auto it = sub_media_vector[indices[i]].begin(); it != sub_media_vector[indices[i]].end(); it++)
+		{
+			//the groups of this filesize are found by binary search
+			auto sizes = std::equal_range(groups_by_filesize.begin(), groups_by_filesize.end(), std::make_pair(it->first, 0), [](std::pair<int, int> const &group1, std::pair<int, int> const &group2)
+			{
+				return group1.first < group2.first;
+			});
+
+			for (auto group = sizes.first; group != sizes.second; group++)
+			{
+				int j = group->second;
+
+				for (auto nit = media_vector[j].begin(); nit != media_vector[j].end(); nit++)
+				{
+					//when correct index is found
+					if (it->first == nit->first)
+					{
+						for (nit; nit != media_vector[j].end();)
+						{
+							//check if current 'it' is the selected 'nit'
+							if (it->second.fpath != nit->second.fpath)
+							{
+								//if duplicate images are found, remove second element found (earliest vector entries are preserved)
+								media_case = match_media_files(it->first, it->second.fpath, nit->second.fpath);
+
+								//if media_files match
+								if (1 == media_case)
+								{
+									//reset media_case
+									media_case = 0;
+
+									//delete offending media from file system (mutex required to not potentially overload system calls)
+									auto wait_start = std::chrono::steady_clock::now();
+
+									{
+										trace_span wait_span("lock_wait");
+										deletion_mutex.lock();
+									}
+
+									metrics.thread_wait_us[thread_slot] += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - wait_start).count();
+
+									{
+										trace_span unlink_span("unlink");
+										media_fs->remove(nit->second.fpath);
+									}
+
+									deletion_mutex.unlock();
+
+									//check if entry needs to be erased from it vector
+									//sync_vectors(sub_media_vector, i, nit);
+
+									//erase entry from nit vector
+									nit = media_vector[j].erase(nit);
+
+									//increase media files deleted counter
+									counter++;
+									metrics.files_removed++;
+								}
+								else
+								{
+									nit++;
+								}
+							}
+							else nit++;
+
+							//may hit end of iteration early due to deletion in media_vector, so check is required
+							if (media_vector[j].end() == nit)
+								break;
+						}
+					}
+					if (media_vector[j].end() == nit)
+						break;
+				}
+			}
+		}
+
+		metrics.thread_groups[thread_slot]++;
+		metrics.stage_done++;
+	}
+
+	metrics.thread_busy_us[thread_slot] += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - thread_start).count();
+}
+
+void sync_vectors(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, int &index, std::vector<std::pair<int, media_data>>::iterator &mt)
+{
+	for (auto it = media_vector[index].begin(); it != media_vector[index].end(); it++)
+	{
+		if (it->second.fpath == mt->second.fpath)
+		{
+			//if deleted element is found in media_vector, remove it
+			media_vector[index].erase(it);
+			break;
+		}
+	}
+}
+//--------------------------------------------------------------------------
+
+
+//deletion of all duplicate media files in directory functions---------------
+void full_duplicate_deletion(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, int &counter, std::vector<char> *groups_distinct)
+{
+	std::vector<std::thread> threads;
+	std::vector<std::vector<int>> thread_queues(thread_count);
+	std::vector<int> temp_counters(thread_count, 0);
+
+	set_stage(stage_compare, media_vector.size());
+	metrics.threads_used = thread_count;
+
+	if (groups_distinct)
+		groups_distinct->assign(media_vector.size(), 0);
+
+	//split vector<vector> indices into one queue per thread
+	for (int i = 0; i < media_vector.size(); i++)
+		thread_queues[i % thread_count].push_back(i);
+
+	//run multithreading if thread queue isn't empty
+	for (int t = 0; t < thread_count; t++)
+	{
+		if (thread_queues[t].empty())
+			continue;
+
+		threads.emplace_back(remove_all_duplicates_from_subvectors, std::ref(media_vector), std::ref(thread_queues[t]), std::ref(temp_counters[t]), t, groups_distinct);
+	}
+
+	//join threads (if ran)
+	for (int t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	for (int t = 0; t < thread_count; t++)
+		counter += temp_counters[t];
+}
+
+void remove_all_duplicates_from_subvectors(std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::vector<int> &indices, int &counter, int thread_slot, std::vector<char> *groups_distinct)
+{
+	int media_case = 0; //return value for match_media_files (-1 is error, 0 is no match, 1 is match)
+	auto thread_start = std::chrono::steady_clock::now();
+
+	set_trace_thread_name("deletion thread " + std::to_string(thread_slot + 1));
+
+	//iterate through indices given to the running thread
+	for (int i = 0; i < indices.size(); i++)
+	{
+		bool all_compared = true; //no comparison of the group failed to read its files
+		long long pairs_known = 0, pairs = 0;
+
+		//iterate the appropiate subvector given by the current index
+		for (auto it = media_vector[indices[i]].begin(); it != media_vector[indices[i]].end(); it++) //likely to cause a crash from ++it's location
+		{
+			//iterate all following elements, comparing against original
+			for (auto nit = std::next(it); nit != media_vector[indices[i]].end();)
+			{
+				//if duplicate images are found, remove second element found (earliest vector entries are preserved)
+				//small files whose digests matched are already known to be identical, files an earlier run proved different still differ
+				pairs++;
+
+				if (0 != it->second.digest_id && it->second.digest_id == nit->second.digest_id)
+					media_case = 1;
+				else if (0 != it->second.distinct_set && it->second.distinct_set == nit->second.distinct_set)
+				{
+					media_case = 0;
+					pairs_known++;
+				}
+				else media_case = match_media_files(it->first, it->second.fpath, nit->second.fpath);
+
+				if (media_case < 0)
+					all_compared = false;
+
+				//if media_files match
+				if (1 == media_case)
+				{
+					//reset media_case
+					media_case = 0;
+
+					//delete offending media from file system (mutex required not to potentially overload system calls)
+					auto wait_start = std::chrono::steady_clock::now();
+
+					{
+						trace_span wait_span("lock_wait");
+						deletion_mutex.lock();
+					}
+
+					metrics.thread_wait_us[thread_slot] += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - wait_start).count();
+
+					{
+						trace_span unlink_span("unlink");
+						media_fs->remove(nit->second.fpath);
+					}
+
+					deletion_mutex.unlock();
+
+					//erase entry from vector
+					nit = media_vector[indices[i]].erase(nit);
+
+					//increase media files deleted counter
+					counter++;
+					metrics.files_removed++;
+				}
+				else
+				{
+					nit++;
+				}
+			}
+			//may hit end of iteration early due to deletion in media_vector, so check is required
+			if (media_vector[indices[i]].end() == it) 
+				break;
+		}
+
+		if (groups_distinct)
+			(*groups_distinct)[indices[i]] = all_compared;
+
+		metrics.pairs_known_distinct += pairs_known;
+
+		if (0 < pairs && pairs == pairs_known)
+			metrics.groups_known_distinct++;
+
+		metrics.thread_groups[thread_slot]++;
+		metrics.stage_done++;
+	}
+
+	metrics.thread_busy_us[thread_slot] += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - thread_start).count();
+}
+//--------------------------------------------------------------------------
+
+
+//pipelined deletion functions----------------------------------------------
+void pipelined_duplicate_deletion(std::wstring &media_dir, bool remove_duplicates, int &counter, int &removed, std::ostream *report)
+{
+	bounded_queue<pipeline_file> walk_queue(pipeline_queue_size); //walk -> size bucketing
+	bounded_queue<pipeline_file> hash_queue(pipeline_queue_size); //size bucketing -> sampling hash
+	std::vector<std::unique_ptr<bounded_queue<pipeline_file>>> verify_queues; //sampling hash -> full verify, one per verify thread
+	bounded_queue<pipeline_action> action_queue(pipeline_queue_size); //full verify -> remove or report
+	std::vector<std::thread> hash_threads, verify_threads;
+	std::thread walk_thread, bucket_thread, action_thread;
+	std::exception_ptr walk_error;
+	trace_span span("pipeline");
+
+	set_stage(stage_pipeline, 0);
+	metrics.threads_used = thread_count;
+
+	for (int t = 0; t < thread_count; t++)
+		verify_queues.emplace_back(new bounded_queue<pipeline_file>(pipeline_queue_size));
+
+	//walk: every media file small enough to compare, in walk order
+	walk_thread = std::thread([&]()
+	{
+		long long sequence = 0;
+
+		set_trace_thread_name("walk");
+
+		try
+		{
+			media_fs->walk(media_dir, [&](std::wstring const &filepath)
+			{
+				counter++;
+				metrics.files_walked++;
+
+				if (!is_media_file(filepath))
+				{
+					metrics.skipped_extension++;
+					return;
+				}
+
+				long long filesize = media_fs->file_size(filepath);
+
+				if (filesize < 0)
+					metrics.skipped_read_error++;
+				else if (max_file_size < filesize)
+					metrics.skipped_too_large++;
+				else
+					walk_queue.push({ sequence++, (int)filesize, 0, filepath });
+			});
+		}
+		catch (...)
+		{
+			//reported by pipelined_duplicate_deletion once every stage has drained
+			walk_error = std::current_exception();
+		}
+
+		walk_queue.close();
+	});
+
+	//size bucketing: the first file of each size is held back until a second file of that size shows up
+	bucket_thread = std::thread([&]()
+	{
+		std::unordered_map<int, pipeline_file> first_of_size; //held files, released (and erased) once their size repeats
+		std::unordered_set<int> released_sizes;
+		pipeline_file file;
+
+		set_trace_thread_name("bucket");
+
+		while (walk_queue.pop(file))
+		{
+			if (released_sizes.count(file.filesize))
+			{
+				metrics.files_candidate++;
+				hash_queue.push(std::move(file));
+				continue;
+			}
+
+			auto held = first_of_size.find(file.filesize);
+
+			if (first_of_size.end() == held)
+			{
+				first_of_size.emplace(file.filesize, std::move(file));
+				continue;
+			}
+
+			//second file of this size, both go downstream now
+			metrics.files_candidate += 2;
+			released_sizes.insert(file.filesize);
+			hash_queue.push(std::move(held->second));
+			hash_queue.push(std::move(file));
+			first_of_size.erase(held);
+		}
+
+		metrics.skipped_unique_size += first_of_size.size();
+
+		hash_queue.close();
+	});
+
+	//sampling hash: files with the same size and hash are routed to the same verify thread
+	for (int t = 0; t < thread_count; t++)
+	{
+		hash_threads.emplace_back([&, t]()
+		{
+			pipeline_file file;
+
+			set_trace_thread_name("hash thread " + std::to_string(t + 1));
+
+			while (hash_queue.pop(file))
+			{
+				file.fhash = get_hash(file.fpath, file.filesize);
+
+				metrics.stage_done++;
+
+				//unreadable files can't be verified
+				if (-1 == file.fhash)
+					continue;
+
+				size_t route = 0;
+				boost::hash_combine(route, file.filesize);
+				boost::hash_combine(route, file.fhash);
+
+				verify_queues[route % thread_count]->push(std::move(file));
+			}
+		});
+	}
+
+	//full verify: each (size, hash) key keeps one representative per distinct content seen so far
+	for (int t = 0; t < thread_count; t++)
+	{
+		verify_threads.emplace_back([&, t]()
+		{
+			std::map<std::pair<int, double>, std::vector<pipeline_file>> representatives;
+			pipeline_file file;
+			auto thread_start = std::chrono::steady_clock::now();
+			long long idle_us = 0;
+
+			set_trace_thread_name("verify thread " + std::to_string(t + 1));
+
+			while (true)
+			{
+				auto wait_start = std::chrono::steady_clock::now();
+
+				if (!verify_queues[t]->pop(file))
+					break;
+
+				idle_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - wait_start).count();
+
+				std::vector<pipeline_file> &known = representatives[std::make_pair(file.filesize, file.fhash)];
+				bool duplicate = false;
+
+				for (int i = 0; i < known.size() && !duplicate; i++)
+				{
+					int media_case = match_media_files(file.filesize, known[i].fpath, file.fpath);
+
+					if (1 == media_case)
+					{
+						duplicate = true;
+
+						//hash threads can reorder files, keep whichever copy was walked first
+						if (file.sequence < known[i].sequence)
+							std::swap(file, known[i]);
+
+						action_queue.push({ file.fpath, known[i].fpath });
+					}
+					//incoming file is unreadable, drop it
+					else if (-2 == media_case)
+						duplicate = true;
+				}
+
+				if (!duplicate)
+					known.push_back(std::move(file));
+
+				metrics.thread_groups[t]++;
+			}
+
+			metrics.thread_busy_us[t] += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - thread_start).count() - idle_us;
+		});
+	}
+
+	//action: remove (or report) verified duplicates one at a time
+	action_thread = std::thread([&]()
+	{
+		pipeline_action action;
+
+		set_trace_thread_name("action");
+
+		while (action_queue.pop(action))
+		{
+			if (report)
+			{
+				std::string duplicate = boost::filesystem::path(action.duplicate).string();
+				std::string original = boost::filesystem::path(action.original).string();
+
+				*report << duplicate << "\t" << original << "\n" << std::flush;
+			}
+
+			if (remove_duplicates)
+			{
+				trace_span unlink_span("unlink");
+
+				if (!media_fs->remove(action.duplicate))
+					continue;
+
+				metrics.files_removed++;
+			}
+
+			removed++;
+		}
+	});
+
+	//each stage closes its output queue once its input is drained, so joining in order shuts the pipeline down
+	walk_thread.join();
+	bucket_thread.join();
+
+	for (int t = 0; t < hash_threads.size(); t++)
+		hash_threads[t].join();
+
+	for (int t = 0; t < verify_queues.size(); t++)
+		verify_queues[t]->close();
+
+	for (int t = 0; t < verify_threads.size(); t++)
+		verify_threads[t].join();
+
+	action_queue.close();
+	action_thread.join();
+
+	if (walk_error)
+		std::rethrow_exception(walk_error);
+}
+//--------------------------------------------------------------------------
+
+
+//daemon functions----------------------------------------------------------
+daemon_index::daemon_index()
+{
+	for (int i = 0; i < daemon_shard_count; i++)
+		shards[i] = std::make_shared<const daemon_shard>();
+}
+
+std::shared_ptr<const daemon_shard> daemon_index::snapshot(int filesize)
+{
+	return std::atomic_load(&shards[(unsigned int)filesize % daemon_shard_count]);
+}
+
+std::mutex &daemon_index::writer_lock(int filesize)
+{
+	return writer_mutexes[(unsigned int)filesize % daemon_shard_count];
+}
+
+void daemon_index::publish(int filesize, std::shared_ptr<const daemon_shard> shard)
+{
+	std::atomic_store(&shards[(unsigned int)filesize % daemon_shard_count], shard);
+}
+
+int daemon_index::indexed_size(std::wstring const &path)
+{
+	std::lock_guard<std::mutex> lock(path_mutex);
+	auto found = path_sizes.find(path);
+
+	return path_sizes.end() == found ? -1 : found->second;
+}
+
+void daemon_index::remember_path(std::wstring const &path, int filesize)
+{
+	std::lock_guard<std::mutex> lock(path_mutex);
+
+	path_sizes[path] = filesize;
+}
+
+void daemon_index::forget_path(std::wstring const &path, int filesize)
+{
+	std::lock_guard<std::mutex> lock(path_mutex);
+	auto found = path_sizes.find(path);
+
+	if (path_sizes.end() != found && found->second == filesize)
+		path_sizes.erase(found);
+}
+
+void build_daemon_index(daemon_index &index, std::wstring &root_dir, int &counter)
+{
+	std::vector<std::unordered_map<int, daemon_bucket>> shards(daemon_shard_count);
+	std::vector<std::thread> threads;
+	trace_span span("build_index");
+
+	set_stage(stage_walk, 0);
+
+	media_fs->walk(root_dir, [&](std::wstring const &filepath)
+	{
+		counter++;
+		metrics.files_walked++;
+
+		if (!is_media_file(filepath))
+		{
+			metrics.skipped_extension++;
+			return;
+		}
+
+		long long filesize = media_fs->file_size(filepath);
+
+		if (filesize < 0)
+			metrics.skipped_read_error++;
+		else if (max_file_size < filesize)
+			metrics.skipped_too_large++;
+		else
+			shards[filesize % daemon_shard_count][(int)filesize].push_back({ 0, false, filepath });
+	});
+
+	set_stage(stage_hash, daemon_shard_count);
+
+	//files with a unique size are compared directly when a lookup hits them, only shared sizes are hashed up front
+	for (int t = 0; t < thread_count; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			set_trace_thread_name("index " + std::to_string(t));
+
+			for (int i = t; i < daemon_shard_count; i += thread_count)
+			{
+				for (auto &bucket : shards[i])
+				{
+					if (1 < bucket.second.size())
+					{
+						for (auto &entry : bucket.second)
+						{
+							entry.fhash = get_hash(entry.fpath, bucket.first);
+							entry.hashed = true;
+						}
+					}
+				}
+
+				metrics.stage_done++;
+			}
+		}));
+	}
+
+	for (int t = 0; t < thread_count; t++)
+		threads[t].join();
+
+	for (int i = 0; i < daemon_shard_count; i++)
+	{
+		std::shared_ptr<daemon_shard> shard = std::make_shared<daemon_shard>();
+
+		for (auto &bucket : shards[i])
+		{
+			for (auto &entry : bucket.second)
+				index.remember_path(entry.fpath, bucket.first);
+
+			(*shard)[bucket.first] = std::make_shared<const daemon_bucket>(std::move(bucket.second));
+		}
+
+		std::lock_guard<std::mutex> lock(index.writer_lock(i));
+		index.publish(i, shard);
+	}
+
+	set_stage(stage_idle, 0);
+}
+
+bool find_in_index(daemon_shard const &shard, int filesize, std::wstring const &path, std::wstring &match)
+{
+	auto bucket = shard.find(filesize);
+	bool path_hashed = false;
+	double path_hash = 0;
+
+	//common case, nothing in the library has this size
+	if (shard.end() == bucket)
+		return false;
+
+	for (auto &entry : *bucket->second)
+	{
+		if (entry.fpath == path)
+			continue;
+
+		//only hash the incoming file once a hashed candidate needs it, a lone unhashed candidate is simply compared
+		if (entry.hashed)
+		{
+			if (!path_hashed)
+			{
+				path_hash = get_hash(path, filesize);
+				path_hashed = true;
+			}
+
+			if (entry.fhash != path_hash)
+				continue;
+		}
+
+		std::wstring candidate = entry.fpath;
+		std::wstring incoming = path;
+
+		if (1 == match_media_files(filesize, incoming, candidate))
+		{
+			match = entry.fpath;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+daemon_status handle_daemon_request(daemon_index &index, char op, std::wstring const &path, std::wstring &match)
+{
+	if (daemon_delete == op)
+	{
+		//the file is usually gone already, so the size it was indexed with comes from the path index
+		int indexed = index.indexed_size(path);
+
+		if (indexed < 0)
+			return daemon_not_indexed;
+
+		std::lock_guard<std::mutex> lock(index.writer_lock(indexed));
+		std::shared_ptr<const daemon_shard> shard = index.snapshot(indexed);
+		auto bucket = shard->find(indexed);
+
+		for (int j = 0; shard->end() != bucket && j < bucket->second->size(); j++)
+		{
+			if ((*bucket->second)[j].fpath == path)
+			{
+				std::shared_ptr<daemon_shard> copy = std::make_shared<daemon_shard>(*shard);
+
+				if (1 == bucket->second->size())
+					copy->erase(indexed);
+				else
+				{
+					std::shared_ptr<daemon_bucket> entries = std::make_shared<daemon_bucket>(*bucket->second);
+
+					entries->erase(entries->begin() + j);
+					(*copy)[indexed] = entries;
+				}
+
+				index.publish(indexed, copy);
+				index.forget_path(path, indexed);
+
+				return daemon_removed;
+			}
+		}
+
+		return daemon_not_indexed;
+	}
+
+	long long filesize = media_fs->file_size(path);
+
+	if (filesize < 0 || max_file_size < filesize || !is_media_file(path))
+		return daemon_skipped;
+
+	if (daemon_lookup == op)
+		return find_in_index(*index.snapshot((int)filesize), (int)filesize, path, match) ? daemon_duplicate : daemon_unique;
+
+	if (daemon_ingest != op)
+		return daemon_bad_request;
+
+	//ingests of one size are serialized so two identical incoming files can't both be added
+	std::lock_guard<std::mutex> lock(index.writer_lock((int)filesize));
+	std::shared_ptr<const daemon_shard> shard = index.snapshot((int)filesize);
+	auto bucket = shard->find((int)filesize);
+
+	if (shard->end() != bucket)
+	{
+		for (auto &entry : *bucket->second)
+		{
+			if (entry.fpath == path)
+				return daemon_indexed;
+		}
+	}
+
+	if (find_in_index(*shard, (int)filesize, path, match))
+		return daemon_duplicate;
+
+	//only this size's bucket is rebuilt, the other buckets of the shard are shared with the published version
+	std::shared_ptr<daemon_shard> copy = std::make_shared<daemon_shard>(*shard);
+	std::shared_ptr<daemon_bucket> entries = shard->end() == bucket ? std::make_shared<daemon_bucket>() : std::make_shared<daemon_bucket>(*bucket->second);
+
+	entries->push_back({ 0, false, path });
+
+	//the size is shared now, so every file of it needs a hash for later lookups
+	if (1 < entries->size())
+	{
+		for (auto &entry : *entries)
+		{
+			if (!entry.hashed)
+			{
+				entry.fhash = get_hash(entry.fpath, (int)filesize);
+				entry.hashed = true;
+			}
+		}
+	}
+
+	(*copy)[(int)filesize] = entries;
+
+	index.publish((int)filesize, copy);
+	index.remember_path(path, (int)filesize);
+
+	return daemon_indexed;
+}
+
+#ifdef _WIN32
+int run_daemon(std::wstring &root_dir, std::string const &socket_path)
+{
+	std::cerr << "daemon mode needs Unix domain sockets and is not available in this build\n";
+	return 1;
+}
+#else
+std::atomic<bool> daemon_stopping(false);
+
+///SIGINT/SIGTERM handler, the accept and client loops notice within daemon_poll_ms
+void stop_daemon(int)
+{
+	daemon_stopping = true;
+}
+
+///reads exactly length bytes, giving up when the peer closes or the daemon is stopping
+bool read_socket(int socket, char *buffer, size_t length)
+{
+	while (0 < length)
+	{
+		pollfd ready = { socket, POLLIN, 0 };
+
+		if (daemon_stopping)
+			return false;
+
+		if (::poll(&ready, 1, daemon_poll_ms) <= 0)
+			continue;
+
+		ssize_t count = ::recv(socket, buffer, length, 0);
+
+		if (count <= 0)
+			return false;
+
+		buffer += count;
+		length -= count;
+	}
+
+	return true;
+}
+
+///writes all of buffer, returns false if the peer went away
+bool write_socket(int socket, char const *buffer, size_t length)
+{
+	while (0 < length)
+	{
+		ssize_t count = ::send(socket, buffer, length, MSG_NOSIGNAL);
+
+		if (count <= 0)
+			return false;
+
+		buffer += count;
+		length -= count;
+	}
+
+	return true;
+}
+
+///answers requests from one client until it disconnects
+void serve_daemon_client(int client, daemon_index &index)
+{
+	char op;
+	uint32_t length;
+
+	while (read_socket(client, &op, 1) && read_socket(client, (char*)&length, sizeof(length)) && length <= daemon_max_path)
+	{
+		std::string request_path(length, '\0');
+		std::wstring match;
+		std::string reply_path;
+		daemon_status status;
+
+		if (!read_socket(client, &request_path[0], length))
+			break;
+
+		{
+			trace_span span("request");
+
+			try
+			{
+				status = handle_daemon_request(index, op, boost::filesystem::path(request_path).wstring(), match);
+			}
+			catch (std::exception &)
+			{
+				status = daemon_bad_request;
+			}
+		}
+
+		if (daemon_duplicate == status)
+			reply_path = boost::filesystem::path(match).string();
+
+		char header[5];
+		uint32_t reply_length = (uint32_t)reply_path.size();
+
+		header[0] = (char)status;
+		std::memcpy(header + 1, &reply_length, sizeof(reply_length));
+
+		if (!write_socket(client, header, sizeof(header)) || !write_socket(client, reply_path.data(), reply_path.size()))
+			break;
+	}
+
+	::close(client);
+}
+
+int run_daemon(std::wstring &root_dir, std::string const &socket_path)
+{
+	daemon_index index;
+	sockaddr_un address = {};
+	std::mutex clients_mutex;
+	std::condition_variable clients_done;
+	int clients = 0; //client threads still running
+	int counter = 0;
+
+	if (sizeof(address.sun_path) <= socket_path.size())
+	{
+		std::cerr << "socket path is too long\n";
+		return 1;
+	}
+
+	auto time1 = std::chrono::high_resolution_clock::now();
+
+	reset_metrics();
+	build_daemon_index(index, root_dir, counter);
+
+	auto ms_taken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - time1);
+
+	int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+	address.sun_family = AF_UNIX;
+	std::strcpy(address.sun_path, socket_path.c_str());
+
+	//a socket file left by an earlier daemon would make bind fail
+	::unlink(socket_path.c_str());
+
+	if (listener < 0 || ::bind(listener, (sockaddr*)&address, sizeof(address)) < 0 || ::listen(listener, SOMAXCONN) < 0)
+	{
+		std::cerr << "unable to listen on " << socket_path << "\n";
+
+		if (0 <= listener)
+			::close(listener);
+
+		return 2;
+	}
+
+	daemon_stopping = false;
+	std::signal(SIGINT, stop_daemon);
+	std::signal(SIGTERM, stop_daemon);
+
+	std::cout << "Indexed " << counter << " files in " << ms_taken.count() << "ms, listening on " << socket_path << std::endl;
+
+	while (!daemon_stopping)
+	{
+		pollfd ready = { listener, POLLIN, 0 };
+
+		if (::poll(&ready, 1, daemon_poll_ms) <= 0)
+			continue;
+
+		int client = ::accept(listener, nullptr, nullptr);
+
+		if (client < 0)
+			continue;
+
+		{
+			std::lock_guard<std::mutex> lock(clients_mutex);
+			clients++;
+		}
+
+		//one thread per connection, lookups only read published shards so clients never wait on each other's ingests
+		std::thread([&, client]()
+		{
+			set_trace_thread_name("client");
+			serve_daemon_client(client, index);
+
+			std::lock_guard<std::mutex> lock(clients_mutex);
+			clients--;
+			clients_done.notify_all();
+		}).detach();
+	}
+
+	::close(listener);
+	::unlink(socket_path.c_str());
+
+	//client threads notice daemon_stopping within daemon_poll_ms
+	std::unique_lock<std::mutex> lock(clients_mutex);
+	clients_done.wait(lock, [&]() { return 0 == clients; });
+
+	std::cout << "Daemon stopped\n";
+
+	return 0;
+}
+#endif
+//--------------------------------------------------------------------------
+
+
+//ingest functions----------------------------------------------------------
+bloom_filter::bloom_filter(size_t key_count)
+{
+	bit_count = (key_count < 64 ? 64 : key_count) * bloom_bits_per_key;
+	bits.assign((size_t)(bit_count + 63) / 64, 0);
+}
+
+void bloom_filter::key_hashes(int filesize, double fhash, unsigned long long &first, unsigned long long &second)
+{
+	unsigned long long hash_bits;
+
+	std::memcpy(&hash_bits, &fhash, sizeof(hash_bits));
+
+	//splitmix64 finalizer over the key, then over its result for the second hash
+	first = hash_bits ^ ((unsigned long long)(unsigned int)filesize * 0x9E3779B97F4A7C15ULL);
+
+	for (int i = 0; i < 2; i++)
+	{
+		first = (first ^ (first >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		first = (first ^ (first >> 27)) * 0x94D049BB133111EBULL;
+		first ^= first >> 31;
+
+		if (0 == i)
+			second = first | 1; //odd, so probes don't repeat early
+	}
+}
+
+void bloom_filter::insert(int filesize, double fhash)
+{
+	unsigned long long first, second;
+
+	key_hashes(filesize, fhash, first, second);
+
+	for (int i = 0; i < bloom_probes; i++)
+	{
+		unsigned long long bit = (first + i * second) % bit_count;
+		bits[bit / 64] |= 1ULL << (bit % 64);
+	}
+}
+
+bool bloom_filter::may_contain(int filesize, double fhash)
+{
+	unsigned long long first, second;
+
+	key_hashes(filesize, fhash, first, second);
+
+	for (int i = 0; i < bloom_probes; i++)
+	{
+		unsigned long long bit = (first + i * second) % bit_count;
+
+		if (0 == (bits[bit / 64] & (1ULL << (bit % 64))))
+			return false;
+	}
+
+	return true;
+}
+
+void build_library_index(std::wstring &root_dir, std::wstring &incoming_dir, std::string const &index_path, int &counter, std::multimap<int, media_data> &library)
+{
+	std::vector<std::pair<int, media_data>> files;
+	std::vector<long long> modified; //modification time of each entry in files
+	std::vector<size_t> stale; //entries in files the index had no current hash for
+	std::unordered_map<std::wstring, indexed_file> indexed;
+	bool index_loaded = false;
+	std::vector<std::thread> threads;
+	std::atomic<size_t> next(0);
+	std::wstring excluded = walked_directory(root_dir, incoming_dir); //a drop folder inside the library isn't part of it
+	trace_span span("library_index");
+
+	if (!index_path.empty() && boost::filesystem::exists(index_path))
+	{
+		index_loaded = read_library_index(index_path, indexed);
+
+		if (!index_loaded)
+			std::cerr << "unable to read " << index_path << ", rescanning" << std::endl;
+	}
+
+	//the library is walked every run, so files added, changed or removed since the index was written are picked up
+	set_stage(stage_walk, 0);
+
+	media_fs->walk(root_dir, [&](std::wstring const &filepath)
+	{
+		counter++;
+		metrics.files_walked++;
+
+		if (!excluded.empty() && path_is_below(filepath, excluded))
+			return;
+
+		if (!is_media_file(filepath))
+		{
+			metrics.skipped_extension++;
+			return;
+		}
+
+		long long filesize = media_fs->file_size(filepath);
+
+		if (filesize < 0)
+			metrics.skipped_read_error++;
+		else if (max_file_size < filesize)
+			metrics.skipped_too_large++;
+		else
+		{
+			long long file_modified = media_fs->modified_time(filepath);
+			auto found = indexed.find(filepath);
+
+			files.push_back({ (int)filesize, { 0, filepath, 0, 0 } });
+			modified.push_back(file_modified);
+
+			//an indexed hash is only reused while the file keeps the size and modification time it was hashed with
+			if (0 <= file_modified && indexed.end() != found && found->second.filesize == filesize && found->second.modified == file_modified)
+				files.back().second.fhash = found->second.fhash;
+			else
+				stale.push_back(files.size() - 1);
+		}
+	});
+
+	//every library file needs a hash, an incoming file may share its size with any of them
+	set_stage(stage_hash, stale.size());
+
+	for (int t = 0; t < thread_count; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			set_trace_thread_name("library " + std::to_string(t));
+
+			for (size_t i = next++; i < stale.size(); i = next++)
+			{
+				files[stale[i]].second.fhash = get_hash(files[stale[i]].second.fpath, files[stale[i]].first);
+				metrics.stage_done++;
+			}
+		}));
+	}
+
+	for (int t = 0; t < thread_count; t++)
+		threads[t].join();
+
+	library.insert(files.begin(), files.end());
+
+	//rewritten when anything was hashed or an indexed file is gone
+	if (!index_path.empty() && (!index_loaded || !stale.empty() || indexed.size() != files.size() - stale.size()) && !write_library_index(index_path, files, modified))
+		std::cerr << "unable to write " << index_path << "\n";
+}
+
+void ingest_directory(std::wstring &incoming_dir, std::multimap<int, media_data> &library, bool link_duplicates, int &counter, int &handled, std::ostream *report)
+{
+	std::vector<std::pair<int, std::wstring>> incoming;
+	std::vector<std::thread> threads;
+	std::atomic<size_t> next(0);
+	std::atomic<int> duplicates(0);
+	std::mutex report_mutex;
+	bloom_filter filter(library.size());
+	boost::system::error_code error;
+	std::wstring incoming_root = boost::filesystem::canonical(incoming_dir, error).wstring();
+	trace_span span("ingest");
+
+	for (auto &entry : library)
+		filter.insert(entry.first, entry.second.fhash);
+
+	media_fs->walk(incoming_dir, [&](std::wstring const &filepath)
+	{
+		counter++;
+		metrics.files_walked++;
+
+		if (!is_media_file(filepath))
+		{
+			metrics.skipped_extension++;
+			return;
+		}
+
+		long long filesize = media_fs->file_size(filepath);
+
+		if (filesize < 0)
+			metrics.skipped_read_error++;
+		else if (max_file_size < filesize)
+			metrics.skipped_too_large++;
+		else
+			incoming.push_back({ (int)filesize, filepath });
+	});
+
+	set_stage(stage_ingest, incoming.size());
+	metrics.threads_used = thread_count;
+
+	for (int t = 0; t < thread_count; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			auto thread_start = std::chrono::steady_clock::now();
+
+			set_trace_thread_name("ingest " + std::to_string(t));
+
+			for (size_t i = next++; i < incoming.size(); i = next++)
+			{
+				int filesize = incoming[i].first;
+				std::wstring &filepath = incoming[i].second;
+				double fhash = get_hash(filepath, filesize);
+
+				metrics.stage_done++;
+				metrics.thread_groups[t]++;
+
+				//most incoming files stop here without any library I/O
+				if (!filter.may_contain(filesize, fhash))
+					continue;
+
+				metrics.filter_hits++;
+
+				auto range = library.equal_range(filesize);
+				bool verified = false;
+
+				for (auto it = range.first; it != range.second && !verified; ++it)
+				{
+					std::wstring candidate = it->second.fpath;
+
+					if (it->second.fhash != fhash || candidate == filepath)
+						continue;
+
+					//another incoming file is never the kept copy, two incoming copies would otherwise remove each other
+					boost::system::error_code candidate_error;
+					std::wstring candidate_path = boost::filesystem::canonical(candidate, candidate_error).wstring();
+
+					if (candidate_error || path_is_below(candidate_path, incoming_root))
+						continue;
+
+					if (1 != match_media_files(filesize, filepath, candidate))
+						continue;
+
+					verified = true;
+
+					trace_span unlink_span("unlink");
+
+					if (link_duplicates ? media_fs->link(candidate, filepath) : media_fs->remove(filepath))
+					{
+						duplicates++;
+						metrics.files_removed++;
+
+						if (report)
+						{
+							std::lock_guard<std::mutex> lock(report_mutex);
+							*report << boost::filesystem::path(filepath).string() << "\t" << boost::filesystem::path(candidate).string() << "\n";
+						}
+					}
+				}
+
+				if (!verified)
+					metrics.filter_false_positives++;
+			}
+
+			metrics.thread_busy_us[t] += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - thread_start).count();
+		}));
+	}
+
+	for (int t = 0; t < thread_count; t++)
+		threads[t].join();
+
+	handled += duplicates;
+}
+
+std::wstring walked_directory(std::wstring &root_dir, std::wstring &directory)
+{
+	boost::system::error_code root_error, directory_error;
+	boost::filesystem::path root = boost::filesystem::canonical(root_dir, root_error);
+	boost::filesystem::path relative = boost::filesystem::canonical(directory, directory_error).lexically_relative(root);
+
+	if (root_error || directory_error || relative.empty() || ".." == *relative.begin())
+		return std::wstring();
+
+	if ("." == relative)
+		return root_dir;
+
+	return (boost::filesystem::path(root_dir) / relative).wstring();
+}
+
+bool path_is_below(std::wstring const &path, std::wstring const &directory)
+{
+	if (0 != path.compare(0, directory.size(), directory))
+		return false;
+
+	//"dir" must not match "dir2", so the next character has to start a new component
+	return path.size() == directory.size() || '/' == path[directory.size()] || boost::filesystem::path::preferred_separator == path[directory.size()] || '/' == directory.back() || boost::filesystem::path::preferred_separator == directory.back();
+}
+
+bool read_database(std::string const &db, std::multimap<int, media_data> &media_map)
+{
+	std::wifstream ifile;
+	std::wstring line;
+	media_data feeder = {};
+	int filesize, count = 0;
+	double hash;
+
+	//paths are written as UTF-8 by write_map_to_db
+	ifile.imbue(std::locale(std::locale::classic(), new std::codecvt_utf8<wchar_t>));
+	ifile.open(db);
+
+	if (!std::getline(ifile, line)) //throw away first line (indexers)
+		return false;
+
+	while (std::getline(ifile, line))
+	{
+		try
+		{
+			if (0 == count) //get filesize
+			{
+				filesize = std::stoi(line);
+				count++;
+			}
+
+			else if (1 == count) //get hash
+			{
+				hash = std::stod(line);
+				count++;
+			}
+
+			else if (2 == count) //get filepath
+			{
+				feeder.fhash = hash;
+				feeder.fpath = line;
+				media_map.emplace(filesize, feeder);
+				count = 0;
+			}
+		}
+
+		catch (std::logic_error const &) //stoi and stod throw invalid_argument or out_of_range on a damaged line
+		{
+			media_map.clear();
+			return false;
+		}
+	}
+
+	ifile.close();
+
+	if (0 != count) //a record cut short means the file was truncated
+	{
+		media_map.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool write_map_to_db(std::string const &db, std::multimap<int, media_data> &media_map)
+{
+	std::locale loc(std::locale::classic(), new std::codecvt_utf8<wchar_t>); // to imbue wofstream with unicode chars
+	std::wofstream database;
+
+	database.imbue(loc);
+
+	//open db
+	database.open(db);
+
+	//check for write permission
+	if (database.fail())
+		return false;
+
+	//prevent hash from being written in sci notation
+	database.setf(std::ios_base::fixed);
+
+	//output first line
+	database << "filesize, file hash, filepath\n";
+
+	//output map data for each element
+	for (std::multimap<int, media_data>::iterator it = media_map.begin(); it != media_map.end(); ++it)
+	{
+		//map_reader = it->second;
+		database << it->first << std::endl;
+		database << it->second.fhash << std::endl;
+		database << it->second.fpath << std::endl;
+	}
+
+	//close file
+	database.close();
+
+	return !database.fail();
+}
+
+bool read_library_index(std::string const &index_path, std::unordered_map<std::wstring, indexed_file> &indexed)
+{
+	std::wifstream ifile;
+	std::wstring line;
+	indexed_file feeder = {};
+	int count = 0;
+
+	//paths are written as UTF-8 by write_library_index
+	ifile.imbue(std::locale(std::locale::classic(), new std::codecvt_utf8<wchar_t>));
+	ifile.open(index_path);
+
+	//indexes written before modification times were recorded can't be checked against the library
+	if (!std::getline(ifile, line) || line != library_index_header)
+		return false;
+
+	while (std::getline(ifile, line))
+	{
+		try
+		{
+			if (0 == count) //get filesize
+				feeder.filesize = std::stoi(line);
+			else if (1 == count) //get hash
+				feeder.fhash = std::stod(line);
+			else if (2 == count) //get modification time
+				feeder.modified = std::stoll(line);
+			else //get filepath
+				indexed[line] = feeder;
+
+			count = (count + 1) % 4;
+		}
+
+		catch (std::logic_error const &) //stoi, stod and stoll throw invalid_argument or out_of_range on a damaged line
+		{
+			indexed.clear();
+			return false;
+		}
+	}
+
+	//a record cut short means the file was truncated
+	if (0 != count)
+	{
+		indexed.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool write_library_index(std::string const &index_path, std::vector<std::pair<int, media_data>> const &files, std::vector<long long> const &modified)
+{
+	std::wofstream database;
+
+	database.imbue(std::locale(std::locale::classic(), new std::codecvt_utf8<wchar_t>));
+	database.open(index_path);
+
+	if (database.fail())
+		return false;
+
+	//prevent hash from being written in sci notation
+	database.setf(std::ios_base::fixed);
+
+	database << library_index_header << "\n";
+
+	for (int i = 0; i < files.size(); i++)
+		database << files[i].first << "\n" << files[i].second.fhash << "\n" << modified[i] << "\n" << files[i].second.fpath << "\n";
+
+	database.close();
+
+	return !database.fail();
+}
+//--------------------------------------------------------------------------
+
+
+//shard functions-----------------------------------------------------------
+std::string digest_hex(std::array<unsigned char, 32> const &digest)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string hex;
+
+	for (int i = 0; i < 32; i++)
+	{
+		hex += digits[digest[i] >> 4];
+		hex += digits[digest[i] & 15];
+	}
+
+	return hex;
+}
+
+bool export_shard(std::wstring &root_dir, std::string const &host, std::string const &shard_path, int &counter)
+{
+	std::vector<shard_record> records;
+	std::vector<std::wstring> paths;
+	std::vector<char> hashed;
+	std::vector<std::thread> threads;
+	std::atomic<size_t> next(0);
+	boost::filesystem::path root(root_dir);
+	std::ofstream shard;
+	trace_span span("export");
+
+	set_stage(stage_walk, 0);
+
+	//every file is exported, a filesize unique on this host may still be shared with another host
+	media_fs->walk(root_dir, [&](std::wstring const &filepath)
+	{
+		counter++;
+		metrics.files_walked++;
+
+		if (!is_media_file(filepath))
+		{
+			metrics.skipped_extension++;
+			return;
+		}
+
+		long long filesize = media_fs->file_size(filepath);
+
+		if (filesize < 0)
+			metrics.skipped_read_error++;
+		else if (max_file_size < filesize)
+			metrics.skipped_too_large++;
+		else
+		{
+			records.push_back({ filesize, {}, boost::filesystem::path(filepath).lexically_relative(root).generic_string(), 0 });
+			paths.push_back(filepath);
+		}
+	});
+
+	set_stage(stage_hash, records.size());
+	hashed.assign(records.size(), 0);
+
+	for (int t = 0; t < thread_count; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			set_trace_thread_name("export " + std::to_string(t));
+
+			for (size_t i = next++; i < records.size(); i = next++)
+			{
+				hashed[i] = hash_whole_file(paths[i], records[i].filesize, records[i].digest.data());
+				metrics.stage_done++;
+			}
+		}));
+	}
+
+	for (int t = 0; t < thread_count; t++)
+		threads[t].join();
+
+	shard.open(shard_path, std::ios::binary);
+
+	if (shard.fail())
+		return false;
+
+	//header: magic, host name, record count, then per record: filesize, digest, path (lengths are native 32 bit, sizes 64 bit)
+	unsigned int host_length = (unsigned int)host.size();
+	unsigned long long record_count = 0;
+
+	for (size_t i = 0; i < records.size(); i++)
+		record_count += hashed[i];
+
+	shard.write(shard_magic, 8);
+	shard.write((char const *)&host_length, sizeof(host_length));
+	shard.write(host.data(), host_length);
+	shard.write((char const *)&record_count, sizeof(record_count));
+
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		unsigned int path_length = (unsigned int)records[i].path.size();
+
+		if (!hashed[i])
+			continue;
+
+		shard.write((char const *)&records[i].filesize, sizeof(records[i].filesize));
+		shard.write((char const *)records[i].digest.data(), 32);
+		shard.write((char const *)&path_length, sizeof(path_length));
+		shard.write(records[i].path.data(), path_length);
+	}
+
+	shard.close();
+
+	return !shard.fail();
+}
+
+bool read_shard(std::string const &shard_path, std::string &host, std::vector<shard_record> &records, int host_index)
+{
+	std::ifstream shard(shard_path, std::ios::binary);
+	char magic[8];
+	unsigned int length;
+	unsigned long long record_count;
+
+	if (!shard.read(magic, 8) || 0 != std::memcmp(magic, shard_magic, 8))
+		return false;
+
+	if (!shard.read((char *)&length, sizeof(length)) || daemon_max_path < length)
+		return false;
+
+	host.resize(length);
+
+	if (!shard.read(&host[0], length) || !shard.read((char *)&record_count, sizeof(record_count)))
+		return false;
+
+	for (unsigned long long i = 0; i < record_count; i++)
+	{
+		shard_record record;
+
+		record.host = host_index;
+
+		if (!shard.read((char *)&record.filesize, sizeof(record.filesize)) || !shard.read((char *)record.digest.data(), 32) || !shard.read((char *)&length, sizeof(length)) || daemon_max_path < length)
+			return false;
+
+		record.path.resize(length);
+
+		if (!shard.read(&record.path[0], length))
+			return false;
+
+		records.push_back(std::move(record));
+	}
+
+	return true;
+}
+
+bool merge_shards(std::vector<std::string> const &shard_paths, std::string const &plan_dir, int &groups, int &removals, long long &bytes)
+{
+	std::vector<std::string> hosts(shard_paths.size());
+	std::vector<shard_record> records;
+	std::vector<std::vector<int>> partitions(merge_partitions);
+	std::vector<std::vector<std::pair<int, int>>> actions(merge_partitions); //(removed record, kept record) per partition
+	std::vector<std::thread> threads;
+	std::atomic<int> next(0), group_count(0);
+	trace_span span("merge");
+
+	for (int i = 0; i < shard_paths.size(); i++)
+	{
+		if (!read_shard(shard_paths[i], hosts[i], records, i))
+		{
+			std::cerr << "unable to read shard " << shard_paths[i] << "\n";
+			return false;
+		}
+
+		//plans are named after hosts, so two shards of one host would overwrite each other's
+		for (int j = 0; j < i; j++)
+		{
+			if (hosts[i] == hosts[j])
+			{
+				std::cerr << "host " << hosts[i] << " appears in more than one shard\n";
+				return false;
+			}
+		}
+	}
+
+	//hash partitioning: equal files always share a partition, so every partition is joined on its own
+	for (int i = 0; i < records.size(); i++)
+		partitions[records[i].digest[0]].push_back(i);
+
+	set_stage(stage_group, merge_partitions);
+
+	for (int t = 0; t < thread_count; t++)
+	{
+		threads.push_back(std::thread([&]()
+		{
+			for (int p = next++; p < merge_partitions; p = next++)
+			{
+				std::vector<int> &partition = partitions[p];
+
+				//order by content, then by preference: earlier shards first, then path
+				std::sort(partition.begin(), partition.end(), [&](int record1, int record2)
+				{
+					shard_record const &a = records[record1], &b = records[record2];
+
+					if (a.digest != b.digest)
+						return a.digest < b.digest;
+
+					if (a.filesize != b.filesize)
+						return a.filesize < b.filesize;
+
+					if (a.host != b.host)
+						return a.host < b.host;
+
+					return a.path < b.path;
+				});
+
+				for (int first = 0, last = 0; first < partition.size(); first = last)
+				{
+					shard_record const &kept = records[partition[first]];
+
+					for (last = first + 1; last < partition.size() && records[partition[last]].digest == kept.digest && records[partition[last]].filesize == kept.filesize; last++)
+						actions[p].push_back({ partition[last], partition[first] });
+
+					if (1 < last - first)
+						group_count++;
+				}
+
+				metrics.stage_done++;
+			}
+		}));
+	}
+
+	for (int t = 0; t < thread_count; t++)
+		threads[t].join();
+
+	groups = group_count;
+
+	//one plan per host holding copies to remove
+	std::vector<std::unique_ptr<std::ofstream>> plans(hosts.size());
+
+	for (int p = 0; p < merge_partitions; p++)
+	{
+		for (auto &action : actions[p])
+		{
+			shard_record const &removed = records[action.first], &kept = records[action.second];
+
+			if (!plans[removed.host])
+			{
+				plans[removed.host].reset(new std::ofstream((boost::filesystem::path(plan_dir) / (hosts[removed.host] + ".plan")).string()));
+				*plans[removed.host] << "#host\t" << hosts[removed.host] << "\n";
+				*plans[removed.host] << "#action\tfilesize\tsha256\tpath\tkept host\tkept path\n";
+			}
+
+			*plans[removed.host] << "remove\t" << removed.filesize << "\t" << digest_hex(removed.digest) << "\t" << removed.path << "\t" << hosts[kept.host] << "\t" << kept.path << "\n";
+
+			removals++;
+			bytes += removed.filesize;
+		}
+	}
+
+	for (int i = 0; i < plans.size(); i++)
+	{
+		if (plans[i] && (plans[i]->close(), plans[i]->fail()))
+		{
+			std::cerr << "unable to write the plan for " << hosts[i] << "\n";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool apply_plan(std::wstring &root_dir, std::string const &plan_path, bool dry_run, int &removed, int &skipped)
+{
+	std::ifstream plan(plan_path);
+	std::string line, host;
+	trace_span span("apply_plan");
+
+	if (plan.fail())
+		return false;
+
+	while (std::getline(plan, line))
+	{
+		std::vector<std::string> fields;
+		size_t start = 0, tab;
+
+		//the header names the host the plan was made for
+		if (0 == line.compare(0, 6, "#host\t"))
+		{
+			host = line.substr(6);
+			continue;
+		}
+
+		if (line.empty() || '#' == line[0])
+			continue;
+
+		while (std::string::npos != (tab = line.find('\t', start)))
+		{
+			fields.push_back(line.substr(start, tab - start));
+			start = tab + 1;
+		}
+
+		fields.push_back(line.substr(start));
+
+		if (6 != fields.size() || "remove" != fields[0])
+		{
+			skipped++;
+			continue;
+		}
+
+		//a damaged or hand edited plan must not reach files outside root_dir, and its size must be a plain number stoll can't throw on
+		if (fields[1].empty() || 18 < fields[1].size() || std::string::npos != fields[1].find_first_not_of("0123456789") || !is_relative_plan_path(fields[3]) || (fields[4] == host && (!is_relative_plan_path(fields[5]) || fields[3] == fields[5])))
+		{
+			skipped++;
+			continue;
+		}
+
+		long long filesize = std::stoll(fields[1]);
+		std::wstring path = (boost::filesystem::path(root_dir) / boost::filesystem::path(fields[3])).wstring();
+		std::array<unsigned char, 32> digest;
+
+		//the plan was made from metadata, so the file must still hash to what the merge saw before it is removed
+		bool verified = media_fs->file_size(path) == filesize && hash_whole_file(path, filesize, digest.data()) && digest_hex(digest) == fields[2];
+
+		//when the kept copy is on this host too, it has to still be here and unchanged
+		if (verified && fields[4] == host)
+		{
+			std::wstring kept = (boost::filesystem::path(root_dir) / boost::filesystem::path(fields[5])).wstring();
+
+			verified = media_fs->file_size(kept) == filesize && hash_whole_file(kept, filesize, digest.data()) && digest_hex(digest) == fields[2];
+		}
+
+		if (!verified)
+		{
+			skipped++;
+			continue;
+		}
+
+		if (dry_run || media_fs->remove(path))
+		{
+			removed++;
+			metrics.files_removed++;
+		}
+		else skipped++;
+	}
+
+	return true;
+}
+
+bool is_relative_plan_path(std::string const &plan_path)
+{
+	boost::filesystem::path path(plan_path);
+
+	if (path.empty() || path.has_root_name() || path.has_root_directory())
+		return false;
+
+	for (auto const &part : path)
+		if (".." == part.string())
+			return false;
+
+	return true;
+}
+//--------------------------------------------------------------------------
+
+
+//chunk overlap functions---------------------------------------------------
+chunk_fingerprint::chunk_fingerprint() : hash(0), pending(0), pending_length(0), total_length(0)
+{
+}
+
+void chunk_fingerprint::mix(unsigned long long word)
+{
+	hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+	hash ^= hash >> 32;
+}
+
+void chunk_fingerprint::update(char const *data, size_t length)
+{
+	total_length += length;
+
+	//complete a word left over from the previous piece
+	while (0 < pending_length && 0 < length)
+	{
+		pending |= (unsigned long long)(unsigned char)*data++ << (8 * pending_length++);
+		length--;
+
+		if (8 == pending_length)
+		{
+			mix(pending);
+			pending = 0;
+			pending_length = 0;
+		}
+	}
+
+	//words are read in native (little-endian) order, like the shard format
+	for (; 8 <= length; data += 8, length -= 8)
+	{
+		unsigned long long word;
+
+		memcpy(&word, data, 8);
+		mix(word);
+	}
+
+	for (; 0 < length; length--)
+		pending |= (unsigned long long)(unsigned char)*data++ << (8 * pending_length++);
+}
+
+unsigned long long chunk_fingerprint::finish()
+{
+	unsigned long long result;
+
+	mix(pending);
+	mix(total_length);
+
+	//final avalanche so that chunks differing in one byte differ in every bit
+	result = hash ^ (hash >> 33);
+	result *= 0xff51afd7ed558ccdULL;
+	result ^= result >> 33;
+	result *= 0xc4ceb9fe1a85ec53ULL;
+	result ^= result >> 33;
+
+	hash = 0;
+	pending = 0;
+	pending_length = 0;
+	total_length = 0;
+
+	return result;
+}
+
+unsigned long long const *gear_table()
+{
+	static std::array<unsigned long long, 256> const table = []()
+	{
+		std::array<unsigned long long, 256> words;
+		std::mt19937_64 generator(0x6765617274616221ULL);
+
+		//fixed seed, chunk boundaries have to land in the same places on every run and host
+		for (int i = 0; i < 256; i++)
+			words[i] = generator();
+
+		return words;
+	}();
+
+	return table.data();
+}
+
+bool chunk_file(std::wstring const &path, long long filesize, int file, std::vector<chunk_entry> &chunks)
+{
+	unsigned long long const *gear = gear_table();
+	unsigned long long const mask_small = ~0ULL << (64 - 18); //stricter below the average length, so few chunks end early
+	unsigned long long const mask_large = ~0ULL << (64 - 14); //looser above it, so few chunks run to the maximum
+	std::unique_ptr<media_file> ifile;
+	chunk_fingerprint fingerprint;
+	unsigned long long hash = 0;
+	long long chunk_start = 0; //file offset of the chunk being cut
+	long long position = 0; //file offset of the buffer
+	trace_span span("chunk");
+
+	{
+		trace_span open_span("open");
+		ifile = media_fs->open(path);
+	}
+
+	if (!ifile)
+	{
+		metrics.skipped_read_error++;
+		return false;
+	}
+
+	pooled_buffers buffer(1);
+
+	while (position < filesize)
+	{
+		long long length = filesize - position < read_pool.chunk_size() ? filesize - position : read_pool.chunk_size();
+		long long count;
+		long long piece_start = 0; //where the current chunk's bytes start in this buffer
+		char const *data = buffer.data[0];
+
+		{
+			trace_span read_span("read");
+			count = ifile->read(buffer.data[0], length);
+		}
+
+		metrics.bytes_chunked += count;
+
+		//shorter than it was when it was sized
+		if (count < length)
+		{
+			metrics.skipped_read_error++;
+			return false;
+		}
+
+		for (long long i = 0; i < count;)
+		{
+			long long chunk_length = position + i - chunk_start;
+
+			//the hash only depends on the last 64 bytes, so nothing before cdc_min_chunk - 64 has to be looked at
+			if (chunk_length < cdc_min_chunk - 64)
+			{
+				i += count - i < cdc_min_chunk - 64 - chunk_length ? count - i : cdc_min_chunk - 64 - chunk_length;
+				continue;
+			}
+
+			hash = (hash << 1) + gear[(unsigned char)data[i++]];
+			chunk_length++;
+
+			if (chunk_length < cdc_min_chunk || (chunk_length < cdc_max_chunk && 0 != (hash & (chunk_length < cdc_avg_chunk ? mask_small : mask_large))))
+				continue;
+
+			fingerprint.update(data + piece_start, (size_t)(i - piece_start));
+			chunks.push_back({ fingerprint.finish(), file, (int)chunk_length, chunk_start });
+
+			chunk_start = position + i;
+			piece_start = i;
+			hash = 0;
+		}
+
+		fingerprint.update(data + piece_start, (size_t)(count - piece_start));
+		position += count;
+	}
+
+	//whatever follows the last cut point
+	if (chunk_start < filesize)
+		chunks.push_back({ fingerprint.finish(), file, (int)(filesize - chunk_start), chunk_start });
+
+	return true;
+}
+
+void analyse_chunk_overlap(std::wstring &root_dir, int min_overlap, bool share_extents, int &counter, int &overlapping, std::ostream *report)
+{
+	std::vector<std::wstring> paths; //every chunked file, in walk order
+	std::vector<long long> sizes;
+	std::vector<std::vector<chunk_entry>> shards(chunk_index_shards);
+	std::vector<std::mutex> shard_locks(chunk_index_shards);
+	std::vector<std::unordered_map<unsigned long long, file_overlap>> thread_overlaps(thread_count); //keyed by file << 32 | earlier file
+	std::map<std::pair<int, int>, file_overlap> overlaps; //(file, earlier file) pairs sharing any chunk
+	std::vector<std::thread> threads;
+	std::atomic<size_t> next(0);
+	trace_span span("overlap");
+
+	set_stage(stage_walk, 0);
+
+	media_fs->walk(root_dir, [&](std::wstring const &filepath)
+	{
+		counter++;
+		metrics.files_walked++;
+		metrics.stage_done++;
+
+		//trimmed and re-muxed copies are mostly videos, which the duplicate modes don't read yet
+		if (!is_media_file(filepath) && !is_video_file(filepath))
+		{
+			metrics.skipped_extension++;
+			return;
+		}
+
+		long long filesize = media_fs->file_size(filepath);
+
+		//streamed in pooled chunks, so max_file_size doesn't apply
+		if (filesize < 0)
+			metrics.skipped_read_error++;
+		else if (cdc_min_file_size <= filesize)
+		{
+			paths.push_back(filepath);
+			sizes.push_back(filesize);
+			metrics.files_candidate++;
+		}
+	});
+
+	set_stage(stage_chunk, paths.size());
+
+	for (int t = 0; t < thread_count; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			std::vector<chunk_entry> chunks;
+			std::vector<std::vector<chunk_entry>> outgoing(chunk_index_shards);
+
+			set_trace_thread_name("chunker " + std::to_string(t));
+
+			for (size_t i = next++; i < paths.size(); i = next++)
+			{
+				chunks.clear();
+
+				if (chunk_file(paths[i], sizes[i], (int)i, chunks))
+				{
+					metrics.chunks_total += chunks.size();
+
+					for (int c = 0; c < chunks.size(); c++)
+						outgoing[chunks[c].fingerprint >> 56].push_back(chunks[c]);
+
+					//each partition is locked once per file rather than once per chunk
+					for (int s = 0; s < chunk_index_shards; s++)
+					{
+						if (outgoing[s].empty())
+							continue;
+
+						std::lock_guard<std::mutex> lock(shard_locks[s]);
+
+						shards[s].insert(shards[s].end(), outgoing[s].begin(), outgoing[s].end());
+						outgoing[s].clear();
+					}
+				}
+
+				metrics.stage_done++;
+			}
+		}));
+	}
+
+	for (int t = 0; t < thread_count; t++)
+		threads[t].join();
+
+	//each partition is sorted and joined on its own, equal chunks end up next to each other with the earliest walked file first
+	set_stage(stage_group, chunk_index_shards);
+	threads.clear();
+	next = 0;
+
+	for (int t = 0; t < thread_count; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			std::unordered_map<unsigned long long, file_overlap> &local = thread_overlaps[t];
+
+			set_trace_thread_name("chunk index " + std::to_string(t));
+
+			for (size_t s = next++; s < chunk_index_shards; s = next++)
+			{
+				std::vector<chunk_entry> &shard = shards[s];
+				trace_span group_span("group");
+
+				std::sort(shard.begin(), shard.end(), [](chunk_entry const &chunk1, chunk_entry const &chunk2)
+				{
+					if (chunk1.fingerprint != chunk2.fingerprint)
+						return chunk1.fingerprint < chunk2.fingerprint;
+
+					if (chunk1.length != chunk2.length)
+						return chunk1.length < chunk2.length;
+
+					if (chunk1.file != chunk2.file)
+						return chunk1.file < chunk2.file;
+
+					return chunk1.offset < chunk2.offset;
+				});
+
+				for (size_t first = 0, i = 1; i <= shard.size(); i++)
+				{
+					if (i < shard.size() && shard[i].fingerprint == shard[first].fingerprint && shard[i].length == shard[first].length)
+						continue;
+
+					//every later copy of the chunk is credited to the earliest file holding it, repeats within that file aren't overlap
+					for (size_t k = first + 1; k < i; k++)
+					{
+						if (shard[k].file == shard[first].file)
+							continue;
+
+						file_overlap &overlap = local[(unsigned long long)shard[k].file << 32 | (unsigned int)shard[first].file];
+
+						overlap.bytes += shard[k].length;
+						metrics.chunks_shared++;
+						metrics.bytes_shared += shard[k].length;
+
+						if (share_extents)
+							overlap.extents.push_back({ shard[k].offset, shard[first].offset, shard[k].length });
+					}
+
+					first = i;
+				}
+
+				std::vector<chunk_entry>().swap(shard);
+				metrics.stage_done++;
+			}
+		}));
+	}
+
+	for (int t = 0; t < thread_count; t++)
+		threads[t].join();
+
+	for (int t = 0; t < thread_count; t++)
+	{
+		for (auto it = thread_overlaps[t].begin(); it != thread_overlaps[t].end(); it++)
+		{
+			file_overlap &overlap = overlaps[{ (int)(it->first >> 32), (int)(it->first & 0xffffffff) }];
+
+			overlap.bytes += it->second.bytes;
+			overlap.extents.insert(overlap.extents.end(), it->second.extents.begin(), it->second.extents.end());
+		}
+
+		thread_overlaps[t].clear();
+	}
+
+	//pairs come out ordered by file, then by the earlier file
+	for (auto it = overlaps.begin(); it != overlaps.end(); it++)
+	{
+		int file = it->first.first, source = it->first.second;
+		file_overlap &overlap = it->second;
+
+		if (overlap.bytes * 100 < min_overlap * sizes[file])
+			continue;
+
+		overlapping++;
+
+		if (report)
+			*report << overlap.bytes * 100 / sizes[file] << "%\t" << boost::filesystem::path(paths[file]).string() << "\t" << boost::filesystem::path(paths[source]).string() << "\n";
+
+		if (!share_extents)
+			continue;
+
+		std::vector<shared_extent> merged;
+
+		std::sort(overlap.extents.begin(), overlap.extents.end(), [](shared_extent const &extent1, shared_extent const &extent2) { return extent1.offset < extent2.offset; });
+
+		//neighbouring chunks shared with neighbouring chunks of the earlier file become one range
+		for (int e = 0; e < overlap.extents.size(); e++)
+		{
+			shared_extent &extent = overlap.extents[e];
+
+			if (!merged.empty() && merged.back().offset + merged.back().length == extent.offset && merged.back().source_offset + merged.back().length == extent.source_offset)
+				merged.back().length += extent.length;
+			else
+				merged.push_back(extent);
+		}
+
+		metrics.bytes_extents_shared += media_fs->share_extents(paths[source], paths[file], merged);
+	}
+}
+//--------------------------------------------------------------------------
+
+
+//distinct cache functions--------------------------------------------------
+bool read_distinct_cache(std::string const &cache_path, std::unordered_map<unsigned long long, distinct_record> &cache)
+{
+	std::ifstream ifile(cache_path, std::ios::binary);
+	boost::system::error_code error;
+	char magic[8];
+	unsigned long long count;
+	distinct_record sizing;
+	unsigned long long const record_bytes = sizeof(unsigned long long) + sizeof(sizing.filesize) + sizeof(sizing.modified) + sizeof(sizing.set);
+
+	//the first run has nothing cached yet
+	if (!boost::filesystem::exists(cache_path))
+		return true;
+
+	unsigned long long file_bytes = boost::filesystem::file_size(cache_path, error);
+
+	if (error || !ifile.read(magic, 8) || 0 != memcmp(magic, distinct_cache_magic, 8) || !ifile.read((char *)&count, sizeof(count)))
+		return false;
+
+	//a damaged count must not size the reservation, the file can't hold more records than its length allows
+	if ((file_bytes - sizeof(magic) - sizeof(count)) / record_bytes < count)
+		return false;
+
+	cache.reserve((size_t)count);
+
+	for (unsigned long long i = 0; i < count; i++)
+	{
+		unsigned long long id;
+		distinct_record record;
+
+		if (!ifile.read((char *)&id, sizeof(id)) || !ifile.read((char *)&record.filesize, sizeof(record.filesize)) || !ifile.read((char *)&record.modified, sizeof(record.modified)) || !ifile.read((char *)&record.set, sizeof(record.set)))
+		{
+			cache.clear();
+			return false;
+		}
+
+		cache[id] = record;
+	}
+
+	return true;
+}
+
+void apply_distinct_cache(std::unordered_map<unsigned long long, distinct_record> &cache, std::vector<std::vector<std::pair<int, media_data>>> &media_vector)
+{
+	std::unordered_map<unsigned long long, distinct_record> current; //every member looked at, with its size and time as of this run
+	trace_span span("distinct_cache");
+
+	for (int i = 0; i < media_vector.size(); i++)
+	{
+		//single files are never compared, so there is nothing to skip or remember
+		if (media_vector[i].size() < 2)
+			continue;
+
+		for (int k = 0; k < media_vector[i].size(); k++)
+		{
+			std::pair<int, media_data> &member = media_vector[i][k];
+			unsigned long long id = path_id(member.second.fpath);
+			long long modified = media_fs->modified_time(member.second.fpath);
+			auto found = cache.find(id);
+
+			//a changed or new file gets no set, so it is compared against every other member again
+			if (0 <= modified && cache.end() != found && found->second.filesize == member.first && found->second.modified == modified)
+				member.second.distinct_set = found->second.set;
+			else
+				member.second.distinct_set = 0;
+
+			current[id] = { member.first, modified, 0 };
+		}
+	}
+
+	cache.swap(current);
+}
+
+bool write_distinct_cache(std::string const &cache_path, std::unordered_map<unsigned long long, distinct_record> &cache, std::vector<std::vector<std::pair<int, media_data>>> &media_vector, std::vector<char> &groups_distinct)
+{
+	std::ofstream ofile;
+	unsigned long long count = 0;
+	int set = 0;
+
+	//only groups left with several files that all differ are worth a set, groups that lost files to deletion included
+	for (int i = 0; i < media_vector.size(); i++)
+	{
+		if (!groups_distinct[i] || media_vector[i].size() < 2)
+			continue;
+
+		set++;
+
+		for (int k = 0; k < media_vector[i].size(); k++)
+		{
+			auto found = cache.find(path_id(media_vector[i][k].second.fpath));
+
+			if (cache.end() != found && 0 <= found->second.modified)
+			{
+				found->second.set = set;
+				count++;
+			}
+		}
+	}
+
+	ofile.open(cache_path, std::ios::binary);
+
+	if (ofile.fail())
+		return false;
+
+	//header: magic and record count, then per record: path id, filesize, modification time, set (native byte order)
+	ofile.write(distinct_cache_magic, 8);
+	ofile.write((char const *)&count, sizeof(count));
+
+	for (auto it = cache.begin(); it != cache.end(); it++)
+	{
+		if (0 == it->second.set)
+			continue;
+
+		ofile.write((char const *)&it->first, sizeof(it->first));
+		ofile.write((char const *)&it->second.filesize, sizeof(it->second.filesize));
+		ofile.write((char const *)&it->second.modified, sizeof(it->second.modified));
+		ofile.write((char const *)&it->second.set, sizeof(it->second.set));
+	}
+
+	ofile.close();
+
+	return !ofile.fail();
+}
+
+unsigned long long path_id(std::wstring const &path)
+{
+	std::string utf8 = boost::filesystem::path(path).string();
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < utf8.size(); i++)
+	{
+		hash ^= (unsigned char)utf8[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+//--------------------------------------------------------------------------
+
+
+//shared functions----------------------------------------------------------
+int match_media_files(int &filesize, std::wstring &file1, std::wstring &file2)
+{
+	auto time1 = std::chrono::steady_clock::now();
+	trace_span span("compare");
+	std::unique_ptr<media_file> ifile1, ifile2;
+	long long remaining = filesize;
+	int media_case = 1; //return value, stays 1 (match) unless a chunk differs
+
+	metrics.comparisons++;
+
+	//open media1
+	{
+		trace_span open_span("open");
+		ifile1 = media_fs->open(file1);
+	}
+
+	//check if media1 opened successfully or return error if it didn't
+	if (!ifile1)
+	{
+		metrics.skipped_read_error++;
+		return -1; //if file1 fails to read, return -1
+	}
+
+	//open media2
+	{
+		trace_span open_span("open");
+		ifile2 = media_fs->open(file2);
+	}
+
+	//check if media2 opened successfully or return error if it didn't
+	if (!ifile2)
+	{
+		metrics.skipped_read_error++;
+		return -2; //if file2 fails to read, return -2
+	}
+
+	//both buffers are leased together so two comparisons can never each hold one and wait for the other
+	pooled_buffers buffers(2);
+	char *buffer1 = buffers.data[0];
+	char *buffer2 = buffers.data[1];
+
+	//compare chunk by chunk, stopping at the first chunk that differs
+	while (0 < remaining)
+	{
+		long long length = remaining < read_pool.chunk_size() ? remaining : read_pool.chunk_size();
+		long long read1, read2;
+
+		{
+			trace_span read_span("read");
+			read1 = ifile1->read(buffer1, length);
+			read2 = ifile2->read(buffer2, length);
+		}
+
+		metrics.bytes_compared += read1 + read2;
+
+		//if buffers differ
+		if (read1 != read2 || 0 != std::memcmp(buffer1, buffer2, read1))
+		{
+			media_case = 0; //return false for match
+			break;
+		}
+
+		//both files ended early at the same point
+		if (read1 < length)
+			break;
+
+		remaining -= length;
+	}
+
+	record_value(metrics.compare_latency_us, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - time1).count());
+
+	return media_case;
+}
+
+void clear_buffer(int &filesize, char *buffer1)
+{
+	//reset selected buffer indices to 0
+	for (int i = 0; i < filesize; i++)
+	{
+		buffer1[i] = 0;
+	}
+}
+//--------------------------------------------------------------------------
+
+
+//batch mode functions------------------------------------------------------
+void print_usage()
+{
+	std::cout << "usage: media_manager                                    interactive menu\n";
+	std::cout << "       media_manager scan --root dir [options]          report potential duplicates, removes nothing\n";
+	std::cout << "       media_manager dedupe-subdir --root dir --subdir dir [options]\n";
+	std::cout << "                                                        remove files duplicated by files in subdir (subdir copies are kept)\n";
+	std::cout << "       media_manager dedupe-all --root dir [options]    remove every duplicate below root\n";
+	std::cout << "       media_manager daemon --root dir --socket path [options]\n";
+	std::cout << "                                                        keep root indexed and answer lookup/ingest/delete requests on a Unix socket\n";
+	std::cout << "       media_manager ingest --root dir --incoming dir [--action remove|link] [--index file] [options]\n";
+	std::cout << "                                                        remove (or hard link) incoming files the library below root already has\n";
+	std::cout << "       media_manager export --root dir --host name --shard file [options]\n";
+	std::cout << "                                                        write every file's size, SHA-256 and root relative path to a shard\n";
+	std::cout << "       media_manager merge --shards file,file,... --plans dir [options]\n";
+	std::cout << "                                                        find files shared across shards, write a removal plan per host (first shard wins)\n";
+	std::cout << "       media_manager apply-plan --root dir --plan file [--dry-run] [options]\n";
+	std::cout << "                                                        remove the files a plan lists after re-hashing each one\n";
+	std::cout << "       media_manager overlap --root dir [--min-overlap percent] [--share-extents] [options]\n";
+	std::cout << "                                                        list files sharing most of their bytes with an earlier file (content-defined chunks)\n\n";
+	std::cout << "options:\n";
+	std::cout << "  --threads n             comparison threads (default " << thread_count << ", max " << max_tracked_threads << ")\n";
+	std::cout << "  --max-file-size size    skip larger files (default " << buffer_size << ", K/M/G suffixes allowed)\n";
+	std::cout << "  --memory-budget size    most memory held in read buffers at once (default " << memory_budget / 1048576 << "M)\n";
+	std::cout << "  --format text|json      result written to stdout (default text)\n";
+	std::cout << "  --engine phased|pipelined\n";
+	std::cout << "                          phased (default) walks, hashes and compares one after another, pipelined overlaps them\n";
+	std::cout << "                          and lists each verified duplicate as it is found (scan and dedupe-all only)\n";
+	std::cout << "  --summary file          also write the JSON run summary to file\n";
+	std::cout << "  --trace file            write a Chrome trace of the run to file\n";
+	std::cout << "  --progress              show the live progress line\n";
+	std::cout << "  --index file            ingest: library index to load, or to save after scanning root when it doesn't exist\n";
+	std::cout << "  --distinct-cache file   dedupe-all: skip comparisons between unchanged files an earlier run proved different\n";
+	std::cout << "  --dry-run               apply-plan: verify and report the removals without deleting anything\n";
+	std::cout << "  --min-overlap percent   overlap: share of a file's bytes that must be in one earlier file (default 50)\n";
+	std::cout << "  --share-extents         overlap: have the filesystem store the shared ranges once (Linux, btrfs or XFS)\n";
+}
+
+int run_batch(int argc, char **argv)
+{
+	std::string command = argv[1];
+	std::wstring root_dir, sub_dir, incoming_dir;
+	std::string format = "text";
+	std::string action = "remove";
+	std::string index_path;
+	std::string engine = "phased";
+	std::string trace_path;
+	std::string socket_path;
+	std::string host, shard_path, shard_list, plan_dir, plan_path;
+	std::string distinct_path; //dedupe-all: cache of groups proven to hold no duplicates
+	bool show_progress = false;
+	bool dry_run = false;
+	bool share_extents = false;
+	int min_overlap = 50; //overlap: percent of a file's bytes that must be shared with one earlier file
+	int overlapping = 0; //overlap: files listed
+	std::vector<std::pair<int, media_data>> media_list;
+	std::vector<subtree_copy> subtree_copies; //directories identical to an earlier walked one
+	std::multimap<int, media_data> library; //ingest only
+	std::vector<std::vector<std::pair<int, media_data>>> media_vector;
+	int counter = 0; //files scanned
+	int removed = 0; //files deleted
+	long long merge_bytes = 0; //bytes a merge's plans would free
+
+	if ("scan" != command && "dedupe-subdir" != command && "dedupe-all" != command && "daemon" != command && "ingest" != command && "export" != command && "merge" != command && "apply-plan" != command && "overlap" != command)
+	{
+		print_usage();
+		return "--help" == command || "-h" == command ? 0 : 1;
+	}
+
+	//batch runs only write a summary file when asked to
+	summary_path.clear();
+
+	//"--name value" arguments, flags without values continue early
+	for (int i = 2; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if ("--progress" == argument)
+		{
+			show_progress = true;
+			continue;
+		}
+
+		if ("--dry-run" == argument)
+		{
+			dry_run = true;
+			continue;
+		}
+
+		if ("--share-extents" == argument)
+		{
+			share_extents = true;
+			continue;
+		}
+
+		if (argc <= i + 1)
+		{
+			std::cerr << "missing value for " << argument << "\n";
+			return 1;
+		}
+
+		std::string value = argv[++i];
+
+		try
+		{
+			if ("--root" == argument) root_dir = boost::filesystem::path(value).wstring();
+			else if ("--subdir" == argument) sub_dir = boost::filesystem::path(value).wstring();
+			else if ("--threads" == argument) thread_count = std::stoi(value);
+			else if ("--max-file-size" == argument)
+			{
+				long long size = parse_size(value);
+				max_file_size = size < 0 || (std::numeric_limits<int>::max)() < size ? -1 : (int)size;
+			}
+			else if ("--memory-budget" == argument) memory_budget = parse_size(value);
+			else if ("--format" == argument) format = value;
+			else if ("--engine" == argument) engine = value;
+			else if ("--summary" == argument) summary_path = value;
+			else if ("--trace" == argument) trace_path = value;
+			else if ("--socket" == argument) socket_path = value;
+			else if ("--incoming" == argument) incoming_dir = boost::filesystem::path(value).wstring();
+			else if ("--action" == argument) action = value;
+			else if ("--index" == argument) index_path = value;
+			else if ("--host" == argument) host = value;
+			else if ("--shard" == argument) shard_path = value;
+			else if ("--shards" == argument) shard_list = value;
+			else if ("--plans" == argument) plan_dir = value;
+			else if ("--plan" == argument) plan_path = value;
+			else if ("--min-overlap" == argument) min_overlap = std::stoi(value);
+			else if ("--distinct-cache" == argument) distinct_path = value;
+			else
+			{
+				std::cerr << "unknown option " << argument << "\n";
+				return 1;
+			}
+		}
+		catch (std::exception &)
+		{
+			std::cerr << "invalid value for " << argument << ": " << value << "\n";
+			return 1;
+		}
+	}
+
+	//options each command can't run without
+	std::string missing;
+
+	if (root_dir.empty() && "merge" != command) missing += " --root";
+	if ("dedupe-subdir" == command && sub_dir.empty()) missing += " --subdir";
+	if ("daemon" == command && socket_path.empty()) missing += " --socket";
+	if ("ingest" == command && incoming_dir.empty()) missing += " --incoming";
+	if ("export" == command && host.empty()) missing += " --host";
+	if ("export" == command && shard_path.empty()) missing += " --shard";
+	if ("merge" == command && shard_list.empty()) missing += " --shards";
+	if ("merge" == command && plan_dir.empty()) missing += " --plans";
+	if ("apply-plan" == command && plan_path.empty()) missing += " --plan";
+
+	if (!missing.empty())
+	{
+		std::cerr << command << " needs" << missing << "\n";
+		return 1;
+	}
+
+	if (thread_count < 1 || max_tracked_threads < thread_count || max_file_size < 0 || memory_budget < 1 || ("text" != format && "json" != format))
+	{
+		std::cerr << "--threads must be 1-" << max_tracked_threads << ", --max-file-size 0-2G, --memory-budget positive, and --format text or json\n";
+		return 1;
+	}
+
+	read_pool.configure(memory_budget, thread_count);
+
+	if (("phased" != engine && "pipelined" != engine) || ("pipelined" == engine && "scan" != command && "dedupe-all" != command))
+	{
+		std::cerr << "--engine must be phased or pipelined (pipelined supports scan and dedupe-all)\n";
+		return 1;
+	}
+
+	if (!distinct_path.empty() && ("dedupe-all" != command || "phased" != engine))
+	{
+		std::cerr << "--distinct-cache only applies to dedupe-all with the phased engine\n";
+		return 1;
+	}
+
+	if (min_overlap < 1 || 100 < min_overlap)
+	{
+		std::cerr << "--min-overlap must be 1-100\n";
+		return 1;
+	}
+
+	if ("remove" != action && "link" != action)
+	{
+		std::cerr << "--action must be remove or link\n";
+		return 1;
+	}
+
+	if ((!root_dir.empty() && !boost::filesystem::is_directory(root_dir)) || (!sub_dir.empty() && !boost::filesystem::is_directory(sub_dir)) || (!incoming_dir.empty() && !boost::filesystem::is_directory(incoming_dir)))
+	{
+		std::cerr << "directory not found\n";
+		return 2;
+	}
+
+	//the daemon runs until it is signalled, it reports nothing but its own startup and shutdown
+	if ("daemon" == command)
+	{
+		int result;
+
+		try
+		{
+			result = run_daemon(root_dir, socket_path);
+		}
+		catch (boost::filesystem::filesystem_error &error)
+		{
+			std::cerr << error.what() << "\n";
+			return 2;
+		}
+
+		if (!trace_path.empty() && !write_trace(trace_path))
+			std::cerr << "unable to write " << trace_path << "\n";
+
+		return result;
+	}
+
+	auto time1 = std::chrono::high_resolution_clock::now();
+
+	reset_metrics();
+
+	if (show_progress)
+		start_progress();
+
+	try
+	{
+		//walk, hash, verify and remove concurrently (scan lists verified duplicates as they are found)
+		if ("pipelined" == engine)
+			pipelined_duplicate_deletion(root_dir, "dedupe-all" == command, counter, removed, "scan" == command && "text" == format ? &std::cout : nullptr);
+		else if ("export" == command)
+		{
+			if (!export_shard(root_dir, host, shard_path, counter))
+			{
+				stop_progress();
+				std::cerr << "unable to write " << shard_path << "\n";
+				return 2;
+			}
+		}
+		else if ("merge" == command)
+		{
+			std::vector<std::string> shard_paths;
+			size_t start = 0, comma;
+
+			while (std::string::npos != (comma = shard_list.find(',', start)))
+			{
+				shard_paths.push_back(shard_list.substr(start, comma - start));
+				start = comma + 1;
+			}
+
+			shard_paths.push_back(shard_list.substr(start));
+			boost::filesystem::create_directories(plan_dir);
+
+			//counter is the number of duplicate groups, removed the number of planned removals
+			if (!merge_shards(shard_paths, plan_dir, counter, removed, merge_bytes))
+			{
+				stop_progress();
+				return 2;
+			}
+		}
+		else if ("apply-plan" == command)
+		{
+			//counter is the number of planned files that were skipped
+			if (!apply_plan(root_dir, plan_path, dry_run, removed, counter))
+			{
+				stop_progress();
+				std::cerr << "unable to read " << plan_path << "\n";
+				return 2;
+			}
+		}
+		else if ("overlap" == command)
+			analyse_chunk_overlap(root_dir, min_overlap, share_extents, counter, overlapping, "text" == format ? &std::cout : nullptr);
+		//check the incoming files against the library, counter ends up as the number of incoming files walked
+		else if ("ingest" == command)
+		{
+			build_library_index(root_dir, incoming_dir, index_path, counter, library);
+
+			counter = 0;
+			ingest_directory(incoming_dir, library, "link" == action, counter, removed, "text" == format ? &std::cout : nullptr);
+		}
+		else
+		{
+			//read files from directory into media_list (only retains files that have potential duplicates)
+			//dedupe-subdir has to see every copy to keep the one inside subdir, so only scan and dedupe-all collapse identical subtrees
+			scan_directories(root_dir, counter, media_list, "dedupe-subdir" == command ? nullptr : &subtree_copies);
+
+			handle_subtree_copies(subtree_copies, "dedupe-all" == command, removed, "scan" == command && "text" == format ? &std::cout : nullptr);
+
+			split_map(media_vector, media_list);
+
+			if ("dedupe-all" == command && !distinct_path.empty())
+			{
+				std::unordered_map<unsigned long long, distinct_record> distinct_cache;
+				std::vector<char> groups_distinct;
+
+				//an unreadable cache only costs the comparisons it would have saved
+				if (!read_distinct_cache(distinct_path, distinct_cache))
+					std::cerr << "unable to read " << distinct_path << ", comparing every group\n";
+
+				apply_distinct_cache(distinct_cache, media_vector);
+				full_duplicate_deletion(media_vector, removed, &groups_distinct);
+
+				if (!write_distinct_cache(distinct_path, distinct_cache, media_vector, groups_distinct))
+					std::cerr << "unable to write " << distinct_path << "\n";
+			}
+			else if ("dedupe-all" == command)
+				full_duplicate_deletion(media_vector, removed, nullptr);
+			else if ("dedupe-subdir" == command)
+				selected_duplicate_deletion(media_vector, sub_dir, removed);
+		}
+	}
+	catch (boost::filesystem::filesystem_error &error)
+	{
+		stop_progress();
+		std::cerr << error.what() << "\n";
+		return 2;
+	}
+
+	auto time2 = std::chrono::high_resolution_clock::now();
+
+	auto ms_taken = std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1);
+
+	finish_run(command, ms_taken.count());
+
+	if ("json" == format)
+		write_run_summary(std::cout, command, ms_taken.count());
+	else if ("export" == command)
+		std::cout << "Exported " << metrics.files_hashed << " of " << counter << " files to " << shard_path << " in " << ms_taken.count() << "ms\n";
+	else if ("merge" == command)
+		std::cout << "Found " << counter << " duplicate groups in " << ms_taken.count() << "ms, the plans in " << plan_dir << " remove " << removed << " files (" << merge_bytes / 1000000 << "MB)\n";
+	else if ("apply-plan" == command)
+		std::cout << (dry_run ? "Would remove " : "Removed ") << removed << " files, " << counter << " were skipped because they changed, are missing, lie outside root or their kept copy is gone (" << ms_taken.count() << "ms)\n";
+	else if ("overlap" == command)
+	{
+		std::cout << "Chunked " << metrics.files_candidate << " of " << counter << " files (" << metrics.bytes_chunked / 1000000 << "MB) into " << metrics.chunks_total << " chunks in " << ms_taken.count() << "ms, ";
+		std::cout << overlapping << " files share at least " << min_overlap << "% of their bytes with an earlier file (" << metrics.bytes_shared / 1000000 << "MB of shared chunks";
+
+		if (share_extents)
+			std::cout << ", " << metrics.bytes_extents_shared / 1000000 << "MB now stored once";
+
+		std::cout << ")\n";
+	}
+	else if ("ingest" == command)
+		std::cout << "Checked " << counter << " incoming files against " << library.size() << " library files in " << ms_taken.count() << "ms, " << removed << " duplicates were " << ("link" == action ? "linked" : "removed") << " (" << metrics.filter_hits << " passed the filter)\n";
+	else if ("scan" == command && "pipelined" == engine)
+		std::cout << "Scanned " << counter << " files in " << ms_taken.count() << "ms, " << removed << " files are duplicates of an earlier file\n";
+	else if ("scan" == command)
+	{
+		int groups = 0, grouped_files = 0;
+
+		//split_map leaves single files whose hash matched nothing in their own groups
+		for (int i = 0; i < media_vector.size(); i++)
+		{
+			if (1 < media_vector[i].size())
+			{
+				groups++;
+				grouped_files += media_vector[i].size();
+			}
+		}
+
+		std::cout << "Scanned " << counter << " files in " << ms_taken.count() << "ms, " << grouped_files << " files in " << groups << " groups may be duplicates";
+
+		if (!subtree_copies.empty())
+			std::cout << ", " << metrics.files_collapsed << " files in " << subtree_copies.size() << " directories are copies of an earlier directory";
+
+		std::cout << "\n";
+	}
+	else std::cout << "Scanned " << counter << " files, " << removed << " duplicate media files were removed in " << ms_taken.count() << "ms\n";
+
+	if (!trace_path.empty() && !write_trace(trace_path))
+		std::cerr << "unable to write " << trace_path << "\n";
+
+	return 0;
+}
+//--------------------------------------------------------------------------
+
+
+//filesystem backend functions----------------------------------------------
+#ifdef _WIN32
+///media_file backed by a wide path ifstream
+class native_file : public media_file
+{
+public:
+	std::ifstream ifile;
+
+	long long read(char *buffer, long long length) override
+	{
+		ifile.read(buffer, length);
+		return ifile.gcount();
+	}
+};
+#else
+///media_file backed by a POSIX file descriptor
+class native_file : public media_file
+{
+public:
+	int descriptor = -1;
+
+	~native_file() override
+	{
+		if (0 <= descriptor)
+			::close(descriptor);
+	}
+
+	long long read(char *buffer, long long length) override
+	{
+		long long total = 0;
+
+		//read may return less than asked for, keep going until length is filled or the file ends
+		while (total < length)
+		{
+			ssize_t bytes = ::read(descriptor, buffer + total, length - total);
+
+			if (bytes < 0 && EINTR == errno)
+				continue;
+
+			if (bytes <= 0)
+				break;
+
+			total += bytes;
+		}
+
+		return total;
+	}
+};
+#endif
+
+void native_filesystem::walk(std::wstring const &root, std::function<void(std::wstring const &)> const &visit)
+{
+	boost::filesystem::recursive_directory_iterator start(root); //root directory
+	const boost::filesystem::recursive_directory_iterator end; //end of root directory (and all subdirectories)
+
+	for (; start != end; ++start)
+	{
+		if (boost::filesystem::is_regular_file(start->status()))
+			visit(start->path().wstring());
+	}
+}
+
+long long native_filesystem::file_size(std::wstring const &path)
+{
+#ifdef _WIN32
+	boost::system::error_code error;
+	long long filesize = boost::filesystem::file_size(path, error);
+
+	return error ? -1 : filesize;
+#else
+	struct stat status;
+
+	if (0 != ::stat(boost::filesystem::path(path).string().c_str(), &status))
+		return -1;
+
+	return status.st_size;
+#endif
+}
+
+long long native_filesystem::modified_time(std::wstring const &path)
+{
+#ifdef _WIN32
+	boost::system::error_code error;
+	std::time_t modified = boost::filesystem::last_write_time(path, error);
+
+	return error ? -1 : (long long)modified;
+#else
+	struct stat status;
+
+	if (0 != ::stat(boost::filesystem::path(path).string().c_str(), &status))
+		return -1;
+
+#ifdef __linux__
+	return status.st_mtim.tv_sec * 1000000000LL + status.st_mtim.tv_nsec;
+#else
+	return status.st_mtime;
+#endif
+#endif
+}
+
+std::unique_ptr<media_file> native_filesystem::open(std::wstring const &path)
+{
+	std::unique_ptr<native_file> file(new native_file);
+
+#ifdef _WIN32
+	file->ifile.open(path, std::ifstream::binary | std::ifstream::in);
+
+	if (file->ifile.fail())
+		return nullptr;
+#else
+	file->descriptor = ::open(boost::filesystem::path(path).string().c_str(), O_RDONLY);
+
+	if (file->descriptor < 0)
+		return nullptr;
+#endif
+
+	return file;
+}
+
+#ifndef _WIN32
+void native_filesystem::read_whole_files(std::vector<std::wstring> const &paths, char *buffer, long long buffer_length, std::function<void(size_t, long long)> const &done)
+{
+	std::vector<int> descriptors(paths.size(), -1);
+
+	//open the whole batch and ask for readahead on every file first, so the kernel fetches them together instead of one per read
+	{
+		trace_span open_span("open");
+
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			descriptors[i] = ::open(boost::filesystem::path(paths[i]).string().c_str(), O_RDONLY);
+
+			if (0 <= descriptors[i])
+				::posix_fadvise(descriptors[i], 0, 0, POSIX_FADV_WILLNEED);
+		}
+	}
+
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		long long total = -1;
+
+		if (0 <= descriptors[i])
+		{
+			trace_span read_span("read");
+			ssize_t count;
+
+			total = 0;
+
+			while (total < buffer_length && 0 < (count = ::read(descriptors[i], buffer + total, buffer_length - total)))
+				total += count;
+
+			::close(descriptors[i]);
+		}
+
+		done(i, total);
+	}
+}
+#endif
+
+#ifdef __linux__
+long long native_filesystem::share_extents(std::wstring const &source, std::wstring const &path, std::vector<shared_extent> const &extents)
+{
+	std::vector<char> request(sizeof(file_dedupe_range) + sizeof(file_dedupe_range_info));
+	file_dedupe_range *range = (file_dedupe_range *)request.data();
+	long long shared = 0;
+	int source_fd = ::open(boost::filesystem::path(source).string().c_str(), O_RDONLY);
+	int target_fd = ::open(boost::filesystem::path(path).string().c_str(), O_RDWR);
+
+	for (int i = 0; 0 <= source_fd && 0 <= target_fd && i < extents.size(); i++)
+	{
+		shared_extent const &extent = extents[i];
+		long long start = (extent.offset + extent_block_size - 1) / extent_block_size * extent_block_size;
+		long long end = (extent.offset + extent.length) / extent_block_size * extent_block_size;
+
+		//blocks only line up when both copies start at the same distance from a block boundary
+		if (0 != (extent.offset - extent.source_offset) % extent_block_size)
+			continue;
+
+		while (start < end)
+		{
+			memset(request.data(), 0, request.size());
+			range->src_offset = extent.source_offset + (start - extent.offset);
+			range->src_length = end - start < extent_request_size ? end - start : extent_request_size;
+			range->dest_count = 1;
+			range->info[0].dest_fd = target_fd;
+			range->info[0].dest_offset = start;
+
+			//the kernel compares both ranges before sharing them, a chunk fingerprint collision is never trusted
+			if (0 != ::ioctl(source_fd, FIDEDUPERANGE, range) || FILE_DEDUPE_RANGE_SAME != range->info[0].status || 0 == range->info[0].bytes_deduped)
+				break;
+
+			shared += range->info[0].bytes_deduped;
+			start += range->info[0].bytes_deduped;
+		}
+	}
+
+	if (0 <= source_fd)
+		::close(source_fd);
+
+	if (0 <= target_fd)
+		::close(target_fd);
+
+	return shared;
+}
+#endif
+
+bool native_filesystem::remove(std::wstring const &path)
+{
+#ifdef _WIN32
+	return 0 == _wremove(path.c_str());
+#else
+	return 0 == ::unlink(boost::filesystem::path(path).string().c_str());
+#endif
+}
+
+///media_file reading generated synthetic contents
+class synthetic_file : public media_file
+{
+public:
+	synthetic_filesystem::synthetic_entry entry;
+	long long position = 0;
+
+	long long read(char *buffer, long long length) override
+	{
+		long long bytes = entry.filesize - position < length ? entry.filesize - position : length;
+
+		//generate a word at a time, starting partway into the first word if position isn't aligned
+		for (long long i = 0; i < bytes;)
+		{
+			unsigned long long word = synthetic_filesystem::content_word(entry, (position + i) >> 3);
+
+			for (int shift = ((position + i) & 7) * 8; shift < 64 && i < bytes; shift += 8, i++)
+				buffer[i] = (char)(word >> shift);
+		}
+
+		position += bytes;
+
+		return bytes;
+	}
+};
+
+synthetic_filesystem::synthetic_filesystem(std::wstring const &root_dir, corpus_config const &config) : root(root_dir), duplicates(0)
+{
+	std::mt19937 generator(config.seed);
+	std::vector<int> originals; //indices of every distinct entry generated so far
+	const wchar_t separator = boost::filesystem::path::preferred_separator;
+
+	//build the directory tree breadth first, each level has directory_fanout children per parent
+	directories.push_back(root);
+
+	for (int level = 0, level_start = 0; level < config.directory_depth; level++)
+	{
+		int level_end = directories.size();
+
+		for (int parent = level_start; parent < level_end; parent++)
+			for (int child = 0; child < config.directory_fanout; child++)
+				directories.push_back(directories[parent] + separator + L"dir_" + std::to_wstring(directories.size()));
+
+		level_start = level_end;
+	}
+
+	entries.resize(config.file_count);
+	removed.reset(new std::atomic<bool>[config.file_count]);
+
+	for (int i = 0; i < config.file_count; i++)
+	{
+		synthetic_entry &entry = entries[i];
+		double roll = std::uniform_real_distribution<double>(0.0, 1.0)(generator);
+
+		//pick a filesize, log-uniform sizes favour small files the way real photo libraries do
+		if (config.log_sizes)
+			entry.filesize = (int)std::exp(std::uniform_real_distribution<double>(std::log((double)config.min_size), std::log((double)config.max_size))(generator));
+		else
+			entry.filesize = std::uniform_int_distribution<int>(config.min_size, config.max_size)(generator);
+
+		entry.header_seed = generator();
+		entry.content_seed = generator();
+		entry.directory = std::uniform_int_distribution<int>(0, directories.size() - 1)(generator);
+
+		//exact copy of an earlier file
+		if (roll < config.duplicate_ratio && !originals.empty())
+		{
+			synthetic_entry &original = entries[originals[std::uniform_int_distribution<int>(0, originals.size() - 1)(generator)]];
+
+			entry.filesize = original.filesize;
+			entry.header_seed = original.header_seed;
+			entry.content_seed = original.content_seed;
+			duplicates++;
+		}
+		//same filesize and hashed header as an earlier file, different afterwards (get_hash can't tell them apart)
+		else if (roll < config.duplicate_ratio + config.collision_ratio && !originals.empty() && bytes_to_hash < entries[originals.back()].filesize)
+		{
+			entry.filesize = entries[originals.back()].filesize;
+			entry.header_seed = entries[originals.back()].header_seed;
+			originals.push_back(i);
+		}
+		//distinct file
+		else originals.push_back(i);
+
+		removed[i] = false;
+	}
+}
+
+unsigned long long synthetic_filesystem::content_word(synthetic_entry const &entry, long long word_index)
+{
+	//splitmix64 of (seed, word index), so any offset can be generated without generating the ones before it
+	unsigned long long word = (word_index * 8 < bytes_to_hash ? entry.header_seed : entry.content_seed) + word_index * 0x9E3779B97F4A7C15ULL;
+
+	word = (word ^ (word >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	word = (word ^ (word >> 27)) * 0x94D049BB133111EBULL;
+
+	return word ^ (word >> 31);
+}
+
+long long synthetic_filesystem::entry_index(std::wstring const &path)
+{
+	size_t start = path.rfind(L"file_");
+	long long index = 0;
+
+	if (std::wstring::npos == start)
+		return -1;
+
+	for (size_t i = start + 5; i < path.size() && L'.' != path[i]; i++)
+	{
+		if (path[i] < L'0' || L'9' < path[i])
+			return -1;
+
+		index = index * 10 + (path[i] - L'0');
+	}
+
+	if (entries.size() <= index || removed[index])
+		return -1;
+
+	return index;
+}
+
+void synthetic_filesystem::walk(std::wstring const &root_dir, std::function<void(std::wstring const &)> const &visit)
+{
+	const wchar_t *extensions[] = { L".jpg", L".jpeg", L".png", L".gif", L".webm" };
+	const wchar_t separator = boost::filesystem::path::preferred_separator;
+	std::vector<char> inside(directories.size(), 0); //1 if the directory is root_dir or below it
+
+	for (int i = 0; i < directories.size(); i++)
+		inside[i] = directories[i] == root_dir || 0 == directories[i].compare(0, root_dir.size() + 1, root_dir + separator);
+
+	for (int i = 0; i < entries.size(); i++)
+	{
+		if (inside[entries[i].directory] && !removed[i])
+			visit(directories[entries[i].directory] + separator + L"file_" + std::to_wstring(i) + extensions[i % 5]);
+	}
+}
+
+long long synthetic_filesystem::file_size(std::wstring const &path)
+{
+	long long index = entry_index(path);
+
+	return 0 <= index ? entries[index].filesize : -1;
+}
+
+std::unique_ptr<media_file> synthetic_filesystem::open(std::wstring const &path)
+{
+	long long index = entry_index(path);
+
+	if (index < 0)
+		return nullptr;
+
+	std::unique_ptr<synthetic_file> file(new synthetic_file);
+	file->entry = entries[index];
+
+	return file;
+}
+
+long long synthetic_filesystem::modified_time(std::wstring const &path)
+{
+	//a regenerated corpus reuses its paths for different contents, so nothing about it may be remembered between runs
+	return -1;
+}
+
+bool synthetic_filesystem::remove(std::wstring const &path)
+{
+	long long index = entry_index(path);
+
+	if (index < 0)
+		return false;
+
+	removed[index] = true;
+
+	return true;
+}
+
+bool native_filesystem::link(std::wstring const &target, std::wstring const &path)
+{
+	boost::filesystem::path temporary = boost::filesystem::path(path).string() + ".link";
+	boost::system::error_code error;
+
+	//link beside the file first so path is never missing if linking fails
+	boost::filesystem::create_hard_link(target, temporary, error);
+
+	if (error)
+		return false;
+
+	boost::filesystem::rename(temporary, path, error);
+
+	if (!error)
+		return true;
+
+	boost::filesystem::remove(temporary, error);
+
+	return false;
+}
+
+void media_filesystem::read_whole_files(std::vector<std::wstring> const &paths, char *buffer, long long buffer_length, std::function<void(size_t, long long)> const &done)
+{
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		std::unique_ptr<media_file> file;
+
+		{
+			trace_span open_span("open");
+			file = open(paths[i]);
+		}
+
+		if (!file)
+		{
+			done(i, -1);
+			continue;
+		}
+
+		trace_span read_span("read");
+
+		done(i, file->read(buffer, buffer_length));
+	}
+}
+
+long long media_filesystem::share_extents(std::wstring const &source, std::wstring const &path, std::vector<shared_extent> const &extents)
+{
+	return 0;
+}
+
+bool synthetic_filesystem::link(std::wstring const &target, std::wstring const &path)
+{
+	//generated contents can't be shared between entries
+	return false;
+}
+
+bool is_media_file(std::wstring const &path)
+{
+	boost::filesystem::path extension = boost::filesystem::path(path).extension();
+
+	//haven't tested with mp4, mp3, or other media formats yet, so they are excluded for now
+	return extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".gif" || extension == ".webm";
+}
+
+bool is_video_file(std::wstring const &path)
+{
+	boost::filesystem::path extension = boost::filesystem::path(path).extension();
+
+	//overlap only chunks bytes and never decodes, so any container can be read
+	return extension == ".mp4" || extension == ".m4v" || extension == ".mov" || extension == ".mkv" || extension == ".avi" || extension == ".wmv" || extension == ".mts" || extension == ".m2ts" || extension == ".webm";
+}
+//--------------------------------------------------------------------------
+
+
+//buffer pool functions-----------------------------------------------------
+void buffer_pool::configure(long long budget_bytes, int threads)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	//each thread compares two files at once, give every thread a pair of chunks when the budget allows it
+	long long chunk = budget_bytes / (2LL * threads);
+
+	if (max_chunk_size < chunk) chunk = max_chunk_size;
+	if (chunk < min_chunk_size) chunk = min_chunk_size;
+
+	chunk -= chunk % buffer_alignment;
+
+	budget = budget_bytes < 2 * chunk ? 2 * chunk : budget_bytes; //a comparison needs two chunks, so that is the smallest usable budget
+	chunk_bytes = chunk;
+
+	//cached buffers may be the wrong size now
+	for (int i = 0; i < free_buffers.size(); i++)
+		boost::alignment::aligned_free(free_buffers[i]);
+
+	free_buffers.clear();
+	allocated = 0;
+}
+
+void buffer_pool::acquire(int count, char **buffers)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	auto wait_start = std::chrono::steady_clock::now();
+
+	//wait until count more chunks fit in the budget (in use chunks are returned by release)
+	available.wait(lock, [&]() { return (in_use + count) * chunk_bytes <= budget; });
+
+	metrics.pool_wait_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - wait_start).count();
+
+	for (int i = 0; i < count; i++)
+	{
+		if (free_buffers.empty())
+		{
+			buffers[i] = (char*)boost::alignment::aligned_alloc(buffer_alignment, chunk_bytes);
+
+			if (nullptr == buffers[i])
+				throw std::bad_alloc();
+
+			allocated++;
+		}
+		else
+		{
+			buffers[i] = free_buffers.back();
+			free_buffers.pop_back();
+		}
+	}
+
+	in_use += count;
+
+	if (metrics.pool_peak_bytes < in_use * chunk_bytes)
+		metrics.pool_peak_bytes = in_use * chunk_bytes;
+}
+
+void buffer_pool::release(int count, char **buffers)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		//keep the buffers for reuse, they are freed when the pool is reconfigured
+		for (int i = 0; i < count; i++)
+			free_buffers.push_back(buffers[i]);
+
+		in_use -= count;
+	}
+
+	available.notify_all();
+}
+
+long long buffer_pool::chunk_size()
+{
+	return chunk_bytes;
+}
+
+long long buffer_pool::budget_size()
+{
+	return budget;
+}
+
+pooled_buffers::pooled_buffers(int buffer_count) : count(buffer_count)
+{
+	read_pool.acquire(count, data);
+}
+
+pooled_buffers::~pooled_buffers()
+{
+	read_pool.release(count, data);
+}
+
+long long parse_size(std::string const &value)
+{
+	size_t suffix = 0;
+	long long size = std::stoll(value, &suffix);
+	int shift = 0;
+
+	//buffers are allocated with the result, so it has to fit a size_t as well as a long long (size_t is 32 bits on x86)
+	unsigned long long limit = (std::min)((unsigned long long)(std::numeric_limits<size_t>::max)(), (unsigned long long)(std::numeric_limits<long long>::max)());
+
+	//optional K, M or G suffix (powers of 1024)
+	if (suffix < value.size())
+	{
+		char unit = std::toupper(value[suffix]);
+
+		if ('K' == unit) shift = 10;
+		else if ('M' == unit) shift = 20;
+		else if ('G' == unit) shift = 30;
+		else throw std::invalid_argument(value);
+
+		if (suffix + 1 < value.size())
+			throw std::invalid_argument(value);
+	}
+
+	if (size < 0 || (limit >> shift) < (unsigned long long)size)
+		throw std::out_of_range(value);
+
+	return size << shift;
+}
+//--------------------------------------------------------------------------
+
+
+//run metrics functions----------------------------------------------------
+void reset_metrics()
+{
+	metrics.start_time = std::chrono::steady_clock::now();
+
+	metrics.stage = stage_idle;
+	metrics.stage_done = 0;
+	metrics.stage_total = 0;
+
+	metrics.files_walked = 0;
+	metrics.files_candidate = 0;
+	metrics.files_hashed = 0;
+	metrics.files_small = 0;
+	metrics.files_removed = 0;
+	metrics.comparisons = 0;
+
+	metrics.skipped_extension = 0;
+	metrics.skipped_too_large = 0;
+	metrics.skipped_unique_size = 0;
+	metrics.skipped_read_error = 0;
+
+	metrics.bytes_hashed = 0;
+	metrics.bytes_compared = 0;
+
+	metrics.pool_peak_bytes = 0;
+	metrics.pool_wait_us = 0;
+
+	metrics.filter_hits = 0;
+	metrics.filter_false_positives = 0;
+
+	metrics.subtrees_collapsed = 0;
+	metrics.files_collapsed = 0;
+
+	metrics.bytes_chunked = 0;
+	metrics.chunks_total = 0;
+	metrics.chunks_shared = 0;
+	metrics.bytes_shared = 0;
+	metrics.bytes_extents_shared = 0;
+
+	metrics.pairs_known_distinct = 0;
+	metrics.groups_known_distinct = 0;
+
+	log2_histogram *histograms[] = { &metrics.group_size, &metrics.hash_latency_us, &metrics.compare_latency_us };
+
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < histogram_buckets; j++)
+			histograms[i]->buckets[j] = 0;
+
+		histograms[i]->count = 0;
+		histograms[i]->sum = 0;
+	}
+
+	for (int i = 0; i < max_tracked_threads; i++)
+	{
+		metrics.thread_busy_us[i] = 0;
+		metrics.thread_wait_us[i] = 0;
+		metrics.thread_groups[i] = 0;
+	}
+
+	metrics.threads_used = 0;
+}
+
+void set_stage(int stage, long long stage_total)
+{
+	metrics.stage_done = 0;
+	metrics.stage_total = stage_total;
+	metrics.stage = stage;
+}
+
+void record_value(log2_histogram &histogram, long long value)
+{
+	int bucket = 0;
+
+	//bucket is the number of significant bits in value
+	while (0 < (value >> bucket) && bucket < histogram_buckets - 1)
+		bucket++;
+
+	histogram.buckets[bucket]++;
+	histogram.count++;
+	histogram.sum += value;
+}
+
+long long histogram_percentile(log2_histogram &histogram, double percentile)
+{
+	long long target = (long long)(histogram.count * percentile);
+	long long seen = 0;
+
+	for (int i = 0; i < histogram_buckets; i++)
+	{
+		seen += histogram.buckets[i];
+
+		//return the largest value the bucket can hold
+		if (seen > target)
+			return (1LL << i) - 1;
+	}
+
+	return 0;
+}
+
+void start_progress()
+{
+	progress_running = true;
+	progress_drawn = false;
+
+	progress_thread = std::thread([]()
+	{
+		std::unique_lock<std::mutex> lock(progress_mutex);
+
+		//wake once a second to redraw the line, or immediately when stop_progress is called
+		while (!progress_signal.wait_for(lock, std::chrono::seconds(1), []() { return !progress_running; }))
+		{
+			double seconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - metrics.start_time).count() / 1000.0;
+			long long done = metrics.stage_done;
+			long long total = metrics.stage_total;
+			double megabytes = (metrics.bytes_hashed + metrics.bytes_compared) / 1000000.0;
+
+			//stderr, so the line never mixes into a JSON summary written to stdout
+			std::cerr << "\r[" << stage_names[metrics.stage] << "] " << done;
+
+			if (0 < total)
+				std::cerr << "/" << total;
+
+			std::cerr << "  " << (long long)(metrics.files_walked / seconds) << " files/s walked, " << (long long)(megabytes / seconds) << " MB/s read";
+
+			//ETA is only known once the amount of work in the stage is known
+			if (0 < total && 0 < done)
+				std::cerr << ", stage ETA " << (long long)(seconds * (total - done) / done) << "s";
+
+			std::cerr << "        " << std::flush;
+			progress_drawn = true;
+		}
+	});
+}
+
+void stop_progress()
+{
+	if (!progress_running)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(progress_mutex);
+		progress_running = false;
+	}
+
+	progress_signal.notify_all();
+	progress_thread.join();
+
+	if (progress_drawn)
+		std::cerr << "\n";
+}
+
+void write_run_summary(std::ostream &out, std::string const &run_name, long long ms_taken)
+{
+	log2_histogram *histograms[] = { &metrics.group_size, &metrics.hash_latency_us, &metrics.compare_latency_us };
+	const char *histogram_names[] = { "group_size", "hash_latency_us", "compare_latency_us" };
+
+	out << "{\n";
+	out << "  \"run\": \"" << run_name << "\",\n";
+	out << "  \"elapsed_ms\": " << ms_taken << ",\n";
+	out << "  \"files\": { \"walked\": " << metrics.files_walked << ", \"candidate\": " << metrics.files_candidate << ", \"hashed\": " << metrics.files_hashed << ", \"small\": " << metrics.files_small << ", \"removed\": " << metrics.files_removed << " },\n";
+	out << "  \"skipped\": { \"extension\": " << metrics.skipped_extension << ", \"too_large\": " << metrics.skipped_too_large << ", \"unique_size\": " << metrics.skipped_unique_size << ", \"read_error\": " << metrics.skipped_read_error << " },\n";
+	out << "  \"bytes_read\": { \"hash\": " << metrics.bytes_hashed << ", \"compare\": " << metrics.bytes_compared << " },\n";
+	out << "  \"comparisons\": " << metrics.comparisons << ",\n";
+	out << "  \"subtrees\": { \"collapsed\": " << metrics.subtrees_collapsed << ", \"files\": " << metrics.files_collapsed << " },\n";
+	out << "  \"chunks\": { \"bytes_read\": " << metrics.bytes_chunked << ", \"total\": " << metrics.chunks_total << ", \"shared\": " << metrics.chunks_shared << ", \"shared_bytes\": " << metrics.bytes_shared << ", \"extent_bytes\": " << metrics.bytes_extents_shared << " },\n";
+	out << "  \"distinct_cache\": { \"pairs_skipped\": " << metrics.pairs_known_distinct << ", \"groups_skipped\": " << metrics.groups_known_distinct << " },\n";
+	out << "  \"filter\": { \"hits\": " << metrics.filter_hits << ", \"false_positives\": " << metrics.filter_false_positives << " },\n";
+	out << "  \"memory\": { \"budget\": " << read_pool.budget_size() << ", \"chunk\": " << read_pool.chunk_size() << ", \"peak\": " << metrics.pool_peak_bytes << ", \"wait_ms\": " << metrics.pool_wait_us / 1000 << " },\n";
+
+	for (int i = 0; i < 3; i++)
+	{
+		log2_histogram &histogram = *histograms[i];
+		int last_bucket = 0;
+
+		for (int j = 0; j < histogram_buckets; j++)
+			if (0 < histogram.buckets[j]) last_bucket = j;
+
+		out << "  \"" << histogram_names[i] << "\": { \"count\": " << histogram.count << ", \"sum\": " << histogram.sum;
+		out << ", \"p50\": " << histogram_percentile(histogram, 0.50) << ", \"p90\": " << histogram_percentile(histogram, 0.90) << ", \"p99\": " << histogram_percentile(histogram, 0.99);
+
+		//bucket n counts values below 2^n
+		out << ", \"log2_buckets\": [";
+
+		for (int j = 0; j <= last_bucket; j++)
+			out << (0 < j ? ", " : "") << histogram.buckets[j];
+
+		out << "] },\n";
+	}
+
+	out << "  \"threads\": [";
+
+	for (int i = 0; i < metrics.threads_used && i < max_tracked_threads; i++)
+		out << (0 < i ? "," : "") << "\n    { \"slot\": " << i << ", \"busy_ms\": " << metrics.thread_busy_us[i] / 1000 << ", \"lock_wait_ms\": " << metrics.thread_wait_us[i] / 1000 << ", \"groups\": " << metrics.thread_groups[i] << " }";
+
+	out << (0 < metrics.threads_used ? "\n  " : "") << "]\n";
+	out << "}\n";
+}
+
+void finish_run(std::string const &run_name, long long ms_taken)
+{
+	std::ofstream summary;
+
+	stop_progress();
+
+	metrics.stage = stage_idle;
+
+	//batch runs without --summary don't write one
+	if (summary_path.empty())
+		return;
+
+	summary.open(summary_path);
+
+	//a missing summary shouldn't stop the program, so write failures are ignored
+	if (summary.fail())
+		return;
+
+	write_run_summary(summary, run_name, ms_taken);
+
+	summary.close();
+}
+//--------------------------------------------------------------------------
+
+
+//timeline tracing functions------------------------------------------------
+trace_span::trace_span(const char *span_name) : name(span_name), start(std::chrono::steady_clock::now())
+{
+}
+
+trace_span::~trace_span()
+{
+	auto end = std::chrono::steady_clock::now();
+	trace_ring &ring = thread_trace_ring();
+	long long slot = ring.written.load(std::memory_order_relaxed);
+
+	//overwrite the oldest event once the ring is full
+	trace_event &event = ring.events[slot % trace_ring_size];
+
+	event.name = name;
+	event.start_us = std::chrono::duration_cast<std::chrono::microseconds>(start - trace_epoch).count();
+	event.duration_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+	ring.written.store(slot + 1, std::memory_order_release);
+}
+
+trace_ring_owner::~trace_ring_owner()
+{
+	if (nullptr == ring)
+		return;
+
+	//keep the recorded events, but let the next new thread continue in this ring
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	ring->in_use = false;
+}
+
+trace_ring &thread_trace_ring()
+{
+	static thread_local trace_ring_owner owner;
+
+	if (nullptr == owner.ring)
+	{
+		std::lock_guard<std::mutex> lock(trace_mutex);
+
+		//reuse a ring left behind by a finished thread before allocating a new one
+		for (int i = 0; i < trace_rings.size(); i++)
+		{
+			if (!trace_rings[i]->in_use)
+			{
+				owner.ring = trace_rings[i];
+				break;
+			}
+		}
+
+		if (nullptr == owner.ring)
+		{
+			owner.ring = new trace_ring;
+			owner.ring->events.resize(trace_ring_size);
+			owner.ring->written = 0;
+			owner.ring->thread_id = trace_rings.size() + 1;
+			owner.ring->thread_name = "thread " + std::to_string(owner.ring->thread_id);
+			trace_rings.push_back(owner.ring);
+		}
+
+		owner.ring->in_use = true;
+	}
+
+	return *owner.ring;
+}
+
+void set_trace_thread_name(std::string const &thread_name)
+{
+	trace_ring &ring = thread_trace_ring();
+
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	ring.thread_name = thread_name;
+}
+
+bool write_trace(std::string const &file)
+{
+	std::ofstream trace;
+	bool first = true;
+
+	trace.open(file);
+
+	if (trace.fail())
+		return false;
+
+	std::lock_guard<std::mutex> lock(trace_mutex);
+
+	trace << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+	for (int i = 0; i < trace_rings.size(); i++)
+	{
+		trace_ring &ring = *trace_rings[i];
+		long long written = ring.written.load(std::memory_order_acquire);
+		long long oldest = written > trace_ring_size ? written - trace_ring_size : 0;
+
+		//metadata event so the viewer shows a readable thread name
+		trace << (first ? "" : ",") << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << ring.thread_id << ", \"args\": {\"name\": \"" << ring.thread_name << "\"}}";
+		first = false;
+
+		//complete ("X") events, oldest first
+		for (long long j = oldest; j < written; j++)
+		{
+			trace_event &event = ring.events[j % trace_ring_size];
+			trace << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << ring.thread_id << ", \"ts\": " << event.start_us << ", \"dur\": " << event.duration_us << "}";
+		}
+	}
+
+	trace << "\n]}\n";
+
+	trace.close();
+
+	return true;
+}
+//--------------------------------------------------------------------------
+
+
+//benchmark functions-------------------------------------------------------
+int generate_corpus(boost::filesystem::path const &root, corpus_config const &config)
+{
+	synthetic_filesystem plan(root.wstring(), config); //the corpus on disk is byte for byte the synthetic library
+	std::vector<char> content;
+
+	for (int i = 0; i < plan.directories.size(); i++)
+		boost::filesystem::create_directories(plan.directories[i]);
+
+	plan.walk(plan.root, [&](std::wstring const &filepath)
+	{
+		std::unique_ptr<media_file> ifile = plan.open(filepath);
+		boost::filesystem::ofstream ofile(boost::filesystem::path(filepath), std::ios::binary | std::ios::out);
+
+		content.resize(plan.file_size(filepath));
+		ifile->read(content.data(), content.size());
+		ofile.write(content.data(), content.size());
+	});
+
+	return plan.duplicates;
+}
+
+long long sample_percentile(std::vector<long long> &samples, double percentile)
+{
+	if (samples.empty())
+		return 0;
+
+	std::sort(samples.begin(), samples.end());
+
+	return samples[(int)((samples.size() - 1) * percentile)];
+}
+
+void print_benchmark_result(std::string const &stage, long long items, long long bytes, long long us_taken, std::vector<long long> &latency_us)
+{
+	double seconds = us_taken / 1000000.0;
+
+	std::cout << std::left << std::setw(22) << stage << std::right;
+	std::cout << std::setw(10) << items << " items " << std::setw(10) << (long long)(0 < seconds ? items / seconds : 0) << " items/s ";
+	std::cout << std::setw(8) << (long long)(0 < seconds ? bytes / seconds / 1000000 : 0) << " MB/s ";
+	std::cout << std::setw(9) << us_taken / 1000 << "ms";
+
+	//stages timed as a whole have no per-item latencies
+	if (!latency_us.empty())
+	{
+		std::cout << "   latency us p50 " << sample_percentile(latency_us, 0.50) << " p90 " << sample_percentile(latency_us, 0.90);
+		std::cout << " p99 " << sample_percentile(latency_us, 0.99) << " max " << sample_percentile(latency_us, 1.0);
+	}
+
+	std::cout << "\n";
+}
+
+int run_benchmarks(int argc, char **argv)
+{
+	corpus_config config;
+	boost::filesystem::path root = boost::filesystem::temp_directory_path() / "media_bench_corpus";
+	bool keep_corpus = false;
+	bool use_synthetic = false; //serve the corpus from synthetic_filesystem instead of writing it to disk
+	std::vector<long long> no_latencies;
+
+	//simple "--name value" argument parsing
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		std::string value = i + 1 < argc ? argv[i + 1] : "";
+
+		//parse_size and the stoi family throw on a malformed or out of range value
+		try
+		{
+			if ("--keep" == argument) { keep_corpus = true; continue; }
+			else if ("--synthetic" == argument) { use_synthetic = true; continue; }
+			else if ("--uniform-sizes" == argument) { config.log_sizes = false; continue; }
+			else if ("--dir" == argument) root = value;
+			else if ("--files" == argument) config.file_count = std::stoi(value);
+			else if ("--min-size" == argument) config.min_size = std::stoi(value);
+			else if ("--max-size" == argument) config.max_size = std::stoi(value);
+			else if ("--dup-ratio" == argument) config.duplicate_ratio = std::stod(value);
+			else if ("--collision-ratio" == argument) config.collision_ratio = std::stod(value);
+			else if ("--depth" == argument) config.directory_depth = std::stoi(value);
+			else if ("--fanout" == argument) config.directory_fanout = std::stoi(value);
+			else if ("--seed" == argument) config.seed = std::stoul(value);
+			else if ("--memory-budget" == argument) memory_budget = parse_size(value);
+			else
+			{
+				std::cout << "usage: media_benchmark [--dir path] [--files n] [--min-size bytes] [--max-size bytes] [--uniform-sizes]\n";
+				std::cout << "                       [--dup-ratio r] [--collision-ratio r] [--depth n] [--fanout n] [--seed n] [--keep] [--synthetic]\n";
+				std::cout << "                       [--memory-budget size]\n";
+				return 1;
+			}
+		}
+		catch (std::exception &)
+		{
+			std::cerr << "invalid value for " << argument << ": " << value << "\n";
+			return 1;
+		}
+
+		i++;
+	}
+
+	if (config.max_size > buffer_size)
+		config.max_size = buffer_size;
+
+	read_pool.configure(memory_budget < 1 ? 1 : memory_budget, thread_count);
+
+	std::wstring root_dir = root.wstring();
+	std::vector<std::pair<int, media_data>> media_list;
+	std::vector<std::vector<std::pair<int, media_data>>> media_vector;
+	std::vector<std::wstring> corpus_files;
+	std::unique_ptr<synthetic_filesystem> synthetic;
+	long long corpus_bytes = 0;
+	int counter = 0;
+
+	//(re)creates the corpus, either on disk or as a synthetic library that never touches the disk
+	auto prepare_corpus = [&]()
+	{
+		if (use_synthetic)
+		{
+			synthetic.reset(new synthetic_filesystem(root_dir, config));
+			media_fs = synthetic.get();
+			return synthetic->duplicates;
+		}
+
+		boost::filesystem::remove_all(root);
+		return generate_corpus(root, config);
+	};
+
+	int duplicates = prepare_corpus();
+	auto time1 = std::chrono::steady_clock::now();
+	auto time2 = std::chrono::steady_clock::now();
+
+	std::cout << "corpus: " << config.file_count << " files (" << duplicates << " duplicates) in " << (use_synthetic ? "synthetic " : "") << root.string() << ", seed " << config.seed << "\n\n";
+
+	//walk: plain directory iteration and file sizes, no reads
+	{
+		time1 = std::chrono::steady_clock::now();
+
+		media_fs->walk(root_dir, [&](std::wstring const &filepath)
+		{
+			corpus_bytes += media_fs->file_size(filepath);
+			corpus_files.push_back(filepath);
+		});
+
+		time2 = std::chrono::steady_clock::now();
+
+		print_benchmark_result("walk", corpus_files.size(), 0, std::chrono::duration_cast<std::chrono::microseconds>(time2 - time1).count(), no_latencies);
+	}
+
+	//get_hash: every file in the corpus
+	{
+		std::vector<long long> latencies;
+		long long bytes = 0;
+
+		time1 = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < corpus_files.size(); i++)
+		{
+			int filesize = media_fs->file_size(corpus_files[i]);
+			auto hash_start = std::chrono::steady_clock::now();
+
+			get_hash(corpus_files[i], filesize);
+
+			latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - hash_start).count());
+			bytes += filesize < bytes_to_hash ? filesize : bytes_to_hash;
+		}
+
+		time2 = std::chrono::steady_clock::now();
+
+		print_benchmark_result("get_hash", latencies.size(), bytes, std::chrono::duration_cast<std::chrono::microseconds>(time2 - time1).count(), latencies);
+	}
+
+	//scan_directories: walk, size filter and hashing of candidates together
+	reset_metrics();
+	time1 = std::chrono::steady_clock::now();
+	scan_directories(root_dir, counter, media_list, nullptr);
+	time2 = std::chrono::steady_clock::now();
+	print_benchmark_result("scan_directories", counter, metrics.bytes_hashed, std::chrono::duration_cast<std::chrono::microseconds>(time2 - time1).count(), no_latencies);
+
+	if (media_list.empty())
+	{
+		std::cout << "\ncorpus has no potential duplicates, nothing left to measure\n";
+		return 0;
+	}
+
+	//split_map: grouping, repeated so small corpora still give a measurable time
+	{
+		std::vector<long long> latencies;
+
+		for (int i = 0; i < 10; i++)
+		{
+			std::vector<std::vector<std::pair<int, media_data>>> groups;
+			std::vector<std::pair<int, media_data>> list = media_list; //split_map empties the list it is given
+			auto split_start = std::chrono::steady_clock::now();
+
+			split_map(groups, list);
+
+			latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - split_start).count());
+		}
+
+		long long total_us = 0;
+
+		for (int i = 0; i < latencies.size(); i++)
+			total_us += latencies[i];
+
+		print_benchmark_result("split_map (x10)", media_list.size() * latencies.size(), 0, total_us, latencies);
+	}
+
+	split_map(media_vector, media_list);
+
+	//match_media_files: first member of each group against every other member
+	{
+		std::vector<long long> latencies;
+		long long bytes = 0;
+
+		time1 = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < media_vector.size(); i++)
+		{
+			for (int j = 1; j < media_vector[i].size(); j++)
+			{
+				auto match_start = std::chrono::steady_clock::now();
+
+				match_media_files(media_vector[i][0].first, media_vector[i][0].second.fpath, media_vector[i][j].second.fpath);
+
+				latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - match_start).count());
+				bytes += 2LL * media_vector[i][0].first;
+			}
+		}
+
+		time2 = std::chrono::steady_clock::now();
+
+		print_benchmark_result("match_media_files", latencies.size(), bytes, std::chrono::duration_cast<std::chrono::microseconds>(time2 - time1).count(), latencies);
+	}
+
+	//full_duplicate_deletion: destructive, runs on the corpus as generated
+	counter = 0;
+	reset_metrics();
+	time1 = std::chrono::steady_clock::now();
+	full_duplicate_deletion(media_vector, counter, nullptr);
+	time2 = std::chrono::steady_clock::now();
+	print_benchmark_result("full_duplicate_del", counter, metrics.bytes_compared, std::chrono::duration_cast<std::chrono::microseconds>(time2 - time1).count(), no_latencies);
+
+	if (counter != duplicates)
+		std::cout << "  warning: removed " << counter << " files, corpus has " << duplicates << " duplicates\n";
+
+	//selected_duplicate_deletion: regenerate the same corpus, then dedupe the first subdirectory against the root
+	prepare_corpus();
+
+	media_list.clear();
+	media_vector.clear();
+	counter = 0;
+
+	scan_directories(root_dir, counter, media_list, nullptr);
+	split_map(media_vector, media_list);
+
+	if (0 < config.directory_depth)
+	{
+		std::wstring sub_dir = (root / "dir_1").wstring();
+
+		counter = 0;
+		reset_metrics();
+		time1 = std::chrono::steady_clock::now();
+		selected_duplicate_deletion(media_vector, sub_dir, counter);
+		time2 = std::chrono::steady_clock::now();
+		print_benchmark_result("selected_duplicate_del", counter, metrics.bytes_compared, std::chrono::duration_cast<std::chrono::microseconds>(time2 - time1).count(), no_latencies);
+	}
+
+	//pipelined_duplicate_deletion: regenerate again, walk to removal in one overlapped pass
+	{
+		int removed = 0;
+
+		prepare_corpus();
+
+		counter = 0;
+		reset_metrics();
+		time1 = std::chrono::steady_clock::now();
+		pipelined_duplicate_deletion(root_dir, true, counter, removed, nullptr);
+		time2 = std::chrono::steady_clock::now();
+		print_benchmark_result("pipelined_dedupe", removed, metrics.bytes_hashed + metrics.bytes_compared, std::chrono::duration_cast<std::chrono::microseconds>(time2 - time1).count(), no_latencies);
+
+		if (removed != duplicates)
+			std::cout << "  warning: removed " << removed << " files, corpus has " << duplicates << " duplicates\n";
+	}
+
+	std::cout << "\ncorpus size " << corpus_bytes / 1000000 << "MB\n";
+
+	media_fs = &native_fs;
+
+	if (!keep_corpus && !use_synthetic)
+		boost::filesystem::remove_all(root);
+
+	return 0;
+}
+//--------------------------------------------------------------------------
+
+
+//test functions------------------------------------------------------------
+bool check(bool passed, std::string const &what)
+{
+	if (!passed)
+	{
+		failed_checks++;
+		std::cout << "  FAILED: " << what << "\n";
+	}
+
+	return passed;
+}
+
+std::unique_ptr<synthetic_filesystem> make_test_filesystem(std::wstring const &root, int directory_count, std::vector<test_file> const &files)
+{
+	corpus_config config;
+
+	config.file_count = files.size();
+	config.directory_depth = 1;
+	config.directory_fanout = directory_count;
+	config.duplicate_ratio = 0;
+	config.collision_ratio = 0;
+
+	std::unique_ptr<synthetic_filesystem> fs(new synthetic_filesystem(root, config));
+
+	//replace the generated entries, the walk lists them in this order
+	for (int i = 0; i < files.size(); i++)
+		fs->entries[i] = { files[i].filesize, files[i].directory, files[i].header_seed, files[i].content_seed };
+
+	return fs;
+}
+
+void test_sha256()
+{
+	std::string million(1000000, 'a');
+	std::array<unsigned char, 32> digest;
+
+	std::cout << "sha256\n";
+
+	sha256("", 0, digest.data());
+	check("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" == digest_hex(digest), "empty message");
+
+	sha256("abc", 3, digest.data());
+	check("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" == digest_hex(digest), "\"abc\"");
+
+	//448 bits, so the length no longer fits in the first block
+	sha256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56, digest.data());
+	check("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" == digest_hex(digest), "448 bit message");
+
+	sha256(million.data(), million.size(), digest.data());
+	check("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" == digest_hex(digest), "one million 'a'");
+
+	//pieces that straddle block boundaries have to give the same digest
+	sha256_state state;
+
+	for (size_t position = 0, piece = 1; position < million.size(); position += piece, piece = piece * 7 % 997 + 1)
+		state.update(million.data() + position, (std::min)(piece, million.size() - position));
+
+	state.finish(digest.data());
+	check("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" == digest_hex(digest), "one million 'a' in uneven pieces");
+}
+
+void test_sort_group_keys()
+{
+	std::mt19937 generator(5);
+	int saved_thread_count = thread_count;
+
+	std::cout << "sort_group_keys\n";
+
+	//few filesizes and hashes, so most keys tie on both and only record orders them
+	for (size_t count : { (size_t)1000, (size_t)parallel_sort_threshold * 3 })
+	{
+		for (int threads : { 1, 3, 4, 8 })
+		{
+			std::vector<group_key> keys, expected;
+
+			for (size_t i = 0; i < count; i++)
+				keys.push_back({ (double)(generator() % 16), (int)(generator() % 64), (int)i });
+
+			std::shuffle(keys.begin(), keys.end(), generator);
+
+			for (int presorted = 0; presorted < 2; presorted++)
+			{
+				//scan_directories hands over keys already in filesize order, which takes the per-run path
+				if (presorted)
+					std::stable_sort(keys.begin(), keys.end(), [](group_key const &key1, group_key const &key2) { return key1.filesize < key2.filesize; });
+
+				std::vector<group_key> sorted = keys;
+
+				expected = keys;
+				std::sort(expected.begin(), expected.end(), group_key_less);
+
+				thread_count = threads;
+				sort_group_keys(sorted);
+
+				bool same = true;
+
+				for (size_t i = 0; i < count && same; i++)
+					same = sorted[i].filesize == expected[i].filesize && sorted[i].fhash == expected[i].fhash && sorted[i].record == expected[i].record;
+
+				check(same, std::to_string(count) + " keys, " + std::to_string(threads) + " threads" + (presorted ? ", presorted by filesize" : ""));
+			}
+		}
+	}
+
+	thread_count = saved_thread_count;
+}
+
+void test_bloom_filter()
+{
+	std::mt19937 generator(3);
+	std::vector<std::pair<int, double>> keys;
+	bloom_filter filter(20000);
+	int misses = 0, false_positives = 0;
+
+	std::cout << "bloom_filter\n";
+
+	for (int i = 0; i < 20000; i++)
+		keys.push_back({ (int)(generator() % 5000000), (double)generator() });
+
+	for (auto &key : keys)
+		filter.insert(key.first, key.second);
+
+	for (auto &key : keys)
+		misses += !filter.may_contain(key.first, key.second);
+
+	check(0 == misses, "no false negatives (" + std::to_string(misses) + " inserted keys missed)");
+
+	//filesizes no inserted key has, sized for about 1% false positives
+	for (int i = 0; i < 20000; i++)
+		false_positives += filter.may_contain(5000000 + (int)(generator() % 5000000), (double)generator());
+
+	check(false_positives < 600, "false positive rate near 1% (" + std::to_string(false_positives) + " of 20000)");
+
+	//an empty library still gets a usable filter
+	bloom_filter empty(0);
+	check(!empty.may_contain(1000, 1.0), "empty filter contains nothing");
+}
+
+void test_chunk_boundaries()
+{
+	boost::filesystem::path directory = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("media_tests_%%%%%%%%");
+	std::mt19937 generator(7);
+	std::string original(4 << 20, 0), prefix(1000, 0);
+	std::vector<chunk_entry> chunks, again, edited_chunks, inserted_chunks;
+	boost::system::error_code error;
+
+	std::cout << "chunk_file\n";
+
+	for (auto &byte : original)
+		byte = (char)generator();
+
+	for (auto &byte : prefix)
+		byte = (char)generator();
+
+	std::string edited = original;
+
+	//overwrite 100 bytes halfway through
+	for (size_t i = original.size() / 2; i < original.size() / 2 + 100; i++)
+		edited[i] = ~edited[i];
+
+	boost::filesystem::create_directories(directory);
+
+	std::string contents[] = { original, edited, prefix + original };
+	std::wstring paths[3];
+
+	for (int i = 0; i < 3; i++)
+	{
+		boost::filesystem::ofstream ofile(directory / ("file_" + std::to_string(i) + ".mp4"), std::ios::binary);
+
+		ofile.write(contents[i].data(), contents[i].size());
+		paths[i] = (directory / ("file_" + std::to_string(i) + ".mp4")).wstring();
+	}
+
+	check(chunk_file(paths[0], original.size(), 0, chunks), "original can be chunked");
+	check(chunk_file(paths[0], original.size(), 0, again), "original can be chunked again");
+	check(chunk_file(paths[1], edited.size(), 1, edited_chunks), "edited copy can be chunked");
+	check(chunk_file(paths[2], original.size() + prefix.size(), 2, inserted_chunks), "copy with an insertion can be chunked");
+
+	//chunks tile the file and stay within their length limits, only the last one may be short
+	long long expected_offset = 0;
+	bool lengths_valid = true;
+
+	for (int i = 0; i < chunks.size(); i++)
+	{
+		lengths_valid = lengths_valid && chunks[i].offset == expected_offset && chunks[i].length <= cdc_max_chunk && (cdc_min_chunk <= chunks[i].length || i + 1 == chunks.size());
+		expected_offset += chunks[i].length;
+	}
+
+	check(lengths_valid && expected_offset == (long long)original.size(), "chunks tile the file within the length limits");
+
+	bool deterministic = chunks.size() == again.size();
+
+	for (int i = 0; deterministic && i < chunks.size(); i++)
+		deterministic = chunks[i].fingerprint == again[i].fingerprint && chunks[i].offset == again[i].offset;
+
+	check(deterministic, "chunking the same bytes twice gives the same chunks");
+
+	//a cut depends only on the bytes before it, so every chunk ending before the edit is unchanged
+	bool prefix_stable = true;
+
+	for (int i = 0; i < chunks.size() && chunks[i].offset + chunks[i].length <= (long long)original.size() / 2; i++)
+		prefix_stable = prefix_stable && i < edited_chunks.size() && chunks[i].fingerprint == edited_chunks[i].fingerprint && chunks[i].offset == edited_chunks[i].offset;
+
+	check(prefix_stable, "boundaries before an edit don't move");
+
+	//after an insertion the boundaries resynchronize, shifted by the inserted length
+	std::map<unsigned long long, long long> inserted_offsets;
+	long long shared_bytes = 0;
+
+	for (auto &chunk : inserted_chunks)
+		inserted_offsets[chunk.fingerprint] = chunk.offset;
+
+	for (auto &chunk : chunks)
+	{
+		auto found = inserted_offsets.find(chunk.fingerprint);
+
+		if (inserted_offsets.end() != found && found->second == chunk.offset + (long long)prefix.size())
+			shared_bytes += chunk.length;
+	}
+
+	check(original.size() * 9 / 10 <= shared_bytes, "an insertion leaves most chunks in place (" + std::to_string(shared_bytes * 100 / original.size()) + "% of bytes shared)");
+
+	boost::filesystem::remove_all(directory, error);
+}
+
+void test_deletion()
+{
+	std::wstring root = L"/media_tests";
+	std::vector<std::pair<int, media_data>> media_list;
+	std::vector<std::vector<std::pair<int, media_data>>> media_vector;
+	std::unique_ptr<synthetic_filesystem> fs;
+	int counter = 0, removed = 0;
+
+	std::cout << "deletion\n";
+
+	//two scans gathered into one list: equal small files in dir_1 and other equal small files of the same size in dir_2
+	fs = make_test_filesystem(root, 2, { { 1, 5000, 1, 1 }, { 1, 5000, 1, 1 }, { 2, 5000, 2, 2 }, { 2, 5000, 2, 2 } });
+	media_fs = fs.get();
+	reset_metrics();
+
+	scan_directories(fs->directories[1], counter, media_list, nullptr);
+	scan_directories(fs->directories[2], counter, media_list, nullptr);
+	split_map(media_vector, media_list);
+	full_duplicate_deletion(media_vector, removed, nullptr);
+
+	check(2 == removed && !fs->removed[0] && fs->removed[1] && !fs->removed[2] && fs->removed[3], "small files from two scans are only removed by their own copies");
+
+	//the same small file in both scans is one group
+	fs = make_test_filesystem(root, 2, { { 1, 5000, 1, 1 }, { 1, 5000, 1, 1 }, { 2, 5000, 1, 1 }, { 2, 5000, 1, 1 } });
+	media_fs = fs.get();
+	media_vector.clear();
+	removed = 0;
+
+	scan_directories(fs->directories[1], counter, media_list, nullptr);
+	scan_directories(fs->directories[2], counter, media_list, nullptr);
+	split_map(media_vector, media_list);
+	full_duplicate_deletion(media_vector, removed, nullptr);
+
+	check(3 == removed && !fs->removed[0], "equal small files from two scans keep only the first");
+
+	//large files: an exact copy, a header collision (same size and hashed bytes, different after them) and an unrelated file of the same size
+	fs = make_test_filesystem(root, 2, { { 1, 200000, 3, 3 }, { 2, 200000, 3, 3 }, { 2, 200000, 3, 4 }, { 1, 100000, 5, 5 }, { 2, 100000, 6, 6 } });
+	media_fs = fs.get();
+	media_vector.clear();
+	removed = 0;
+
+	scan_directories(root, counter, media_list, nullptr);
+	split_map(media_vector, media_list);
+	full_duplicate_deletion(media_vector, removed, nullptr);
+
+	check(1 == removed && fs->removed[1] && !fs->removed[0] && !fs->removed[2] && !fs->removed[3] && !fs->removed[4], "only the exact copy of a large file is removed");
+
+	//selected deletion with groups out of filesize order: dir_2 is scanned before dir_3, whose copies of the dir_1 file are smaller
+	fs = make_test_filesystem(root, 3, { { 1, 70000, 7, 7 }, { 3, 70000, 7, 7 }, { 3, 70000, 7, 7 }, { 2, 80000, 8, 8 }, { 2, 80000, 8, 8 }, { 2, 90000, 9, 9 }, { 2, 90000, 9, 9 } });
+	media_fs = fs.get();
+	media_vector.clear();
+	removed = 0;
+
+	scan_directories(fs->directories[2], counter, media_list, nullptr);
+	split_map(media_vector, media_list);
+	scan_directories(fs->directories[3], counter, media_list, nullptr);
+	split_map(media_vector, media_list);
+	selected_duplicate_deletion(media_vector, fs->directories[1], removed);
+
+	check(2 == removed && !fs->removed[0] && fs->removed[1] && fs->removed[2] && !fs->removed[3] && !fs->removed[5], "selected deletion finds groups appended out of filesize order");
+
+	media_fs = &native_fs;
+}
+
+void test_input_validation()
+{
+	bool threw = false;
+
+	std::cout << "input validation\n";
+
+	check(64LL << 20 == parse_size("64M") && 3LL << 30 == parse_size("3g") && 1000 == parse_size("1000"), "sizes with and without a suffix");
+
+	for (std::string value : { "", "5MB", "-1", "x", "99999999999999999999", "9000000000G" })
+	{
+		try
+		{
+			threw = false;
+			parse_size(value);
+		}
+		catch (std::exception &)
+		{
+			threw = true;
+		}
+
+		check(threw, "parse_size rejects \"" + value + "\"");
+	}
+
+	check(is_relative_plan_path("photos/a.jpg") && is_relative_plan_path("./a.jpg"), "relative plan paths are accepted");
+	check(!is_relative_plan_path("") && !is_relative_plan_path("/etc/a.jpg") && !is_relative_plan_path("../a.jpg") && !is_relative_plan_path("photos/../../a.jpg"), "plan paths leaving root are rejected");
+}
+
+int run_tests()
+{
+	read_pool.configure(memory_budget, thread_count);
+
+	test_sha256();
+	test_sort_group_keys();
+	test_bloom_filter();
+	test_chunk_boundaries();
+	test_deletion();
+	test_input_validation();
+
+	std::cout << "\n" << (0 == failed_checks ? "all checks passed" : std::to_string(failed_checks) + " checks failed") << "\n";
+
+	return 0 == failed_checks ? 0 : 1;
+}
+//--------------------------------------------------------------------------
+
+
+//currently unused functions------------------------------------------------
+void debug()
+{
+	/*int _switch = 1;
+	std::wstring fpath = L"G:\\projects\\test images";
+	std::wstring subfolder = L"G:\\projects\\test images\\sub folder";
+
+	scan_directories(fpath, counter, media_map);
+
+	//split mmap into vector array
+	split_map(media_vector, media_map);
+
+	counter = 0;
+
+	//std::vector<int> test_vec;
+	//test_vec.push_back(0);
+	//test_vec.push_back(1);
+	//test_vec.push_back(2);
+	//test_vec.push_back(3);
+
+	//log time taken to run function
+	auto time1 = std::chrono::high_resolution_clock::now();
+
+	selected_duplicate_deletion(media_vector, subfolder, counter);
+	//read files from directory into media_map (only retains files that have potential duplicates)
+	//full_duplicate_deletion(media_vector, counter);
+
+	auto time2 = std::chrono::high_resolution_clock::now();
+
+	auto ms_taken1 = std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1);
+
+	std::cout << "\nRemoved " << counter << " files in " << ms_taken1.count() << "ms\n\n";
+
+	//log time taken to run function
+	auto time3 = std::chrono::high_resolution_clock::now();
+
+	//selected_duplicate_deletion(media_vector, subfolder, counter);
+	//read files from directory into media_map (only retains files that have potential duplicates)
+	full_duplicate_deletion(media_vector, counter);
+
+	auto time4 = std::chrono::high_resolution_clock::now();
+
+	auto ms_taken2 = std::chrono::duration_cast<std::chrono::milliseconds>(time4 - time3);
+
+	std::cout << "\nRemoved " << counter << " files in " << ms_taken2.count() << "ms\n\n";
+
+	//final_cleanup(ifile1, ifile2, separated_filesizes, counter);*/
+}
+
 //--------------------------------------------------------------------------
\ No newline at end of file